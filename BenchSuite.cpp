@@ -0,0 +1,237 @@
+// Render benchmark suite: the built in scenes at a fixed resolution, spp and seed on the CPU
+// tracer, reported as JSON so runs can be compared across versions and machines.
+// Build with CMake (target SpeedTracerBench), which defines SPEEDTRACER_HEADLESS.
+#include "Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Scene.h"
+#include "Camera.h"
+#include "WideBVH.h"
+#include "Simd.h"
+#include "Scenes.h"
+
+#ifndef SPEEDTRACER_VERSION
+#define SPEEDTRACER_VERSION "unknown"
+#endif
+
+struct BenchCase
+{
+	std::string name;
+	Scene scene;
+};
+
+struct BenchResult
+{
+	std::string name;
+	int objects = 0;
+	double buildMs = 0;
+	std::vector<double> renderMs;
+	RenderStats stats;
+
+	double MedianMs() const
+	{
+		std::vector<double> sorted = renderMs;
+		std::sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		return n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+	}
+	double BestMs() const { return *std::min_element(renderMs.begin(), renderMs.end()); }
+};
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: SpeedTracerBench [options]\n"
+		"  --json PATH     write the results there instead of to stdout, and print a table\n"
+		"  --threads N     render threads, 0 for every hardware thread (default 0)\n"
+		"  --repeat N      timed renders per scene after one warm up render (default 5)\n"
+		"  --quick         320x180 at 4 spp, 1 repeat, no 100k ball scene; for smoke tests\n");
+}
+
+static std::string CompilerName()
+{
+#if defined(__clang__)
+	return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+	return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc " + std::to_string(_MSC_FULL_VER);
+#else
+	return "unknown";
+#endif
+}
+
+static std::string CpuName()
+{
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line))
+	{
+		if (line.compare(0, 10, "model name") != 0) continue;
+		size_t colon = line.find(':');
+		if (colon != std::string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+	}
+	return "unknown";
+}
+
+// Quotes s as a JSON string
+static std::string Json(const std::string& s)
+{
+	std::string out = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') out += '\\';
+		if ((unsigned char)c < 0x20) continue;
+		out += c;
+	}
+	return out + "\"";
+}
+
+int main(int argc, char* argv[])
+{
+	std::string jsonPath;
+	int threads = 0, repeat = 5;
+	int width = 640, height = 360, spp = 16;
+	const uint32_t seed = 1;
+	const int maxDepth = 4;
+	bool quick = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--help" || arg == "-h")
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (arg == "--quick") quick = true;
+		else if (arg == "--json" && hasValue) jsonPath = argv[++i];
+		else if (arg == "--threads" && hasValue) threads = atoi(argv[++i]);
+		else if (arg == "--repeat" && hasValue) repeat = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Unknown option or missing value: %s\n", arg.c_str());
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (quick)
+	{
+		width = 320;
+		height = 180;
+		spp = 4;
+		repeat = 1;
+	}
+	repeat = std::max(1, repeat);
+
+	// Fixed ball seeds so every run traces the same clouds
+	std::vector<BenchCase> cases;
+	cases.push_back({ "TestScene", TestScene() });
+	cases.push_back({ "SampleScene", SampleScene() });
+	cases.push_back({ "BasicScene", BasicScene() });
+	cases.push_back({ "Room", Room() });
+	cases.push_back({ "LotsOBalls", LotsOBalls(24, 1) });
+	cases.push_back({ "LotsOBalls 1k", LotsOBalls(1000, 1) });
+	cases.push_back({ "LotsOBalls 10k", LotsOBalls(10000, 1) });
+	if (!quick) cases.push_back({ "LotsOBalls 100k", LotsOBalls(100000, 1) });
+
+	Camera cam(width, height, spp);
+	cam.outputPath = "";
+	cam.threadCount = threads;
+	cam.seed = seed;
+	cam.maxRays = maxDepth;
+
+	std::vector<BenchResult> results;
+	for (BenchCase& c : cases)
+	{
+		BenchResult result;
+		result.name = c.name;
+		result.objects = int(c.scene.objects.size());
+
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		WideBVH bvh(c.scene.objects);
+		result.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+		free(cam.Render(bvh, c.scene.materials));
+		for (int r = 0; r < repeat; r++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			free(cam.Render(bvh, c.scene.materials));
+			result.renderMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+		// The counts are the same every repeat, the seed fixes every path
+		result.stats = cam.stats;
+		results.push_back(result);
+		fprintf(stderr, "%-16s %9.1f ms\n", c.name.c_str(), result.MedianMs());
+	}
+
+	std::string json = "{\n";
+	json += "  \"benchmark\": \"SpeedTracerBench\",\n";
+	json += "  \"version\": " + Json(SPEEDTRACER_VERSION) + ",\n";
+	json += "  \"compiler\": " + Json(CompilerName()) + ",\n";
+	json += "  \"cpu\": " + Json(CpuName()) + ",\n";
+	json += "  \"simd\": " + Json(SimdName()) + ",\n";
+	json += "  \"threads\": " + std::to_string(cam.Pool().WorkerCount()) + ",\n";
+	json += "  \"hardwareThreads\": " + std::to_string(std::thread::hardware_concurrency()) + ",\n";
+	json += "  \"settings\": { \"width\": " + std::to_string(width) + ", \"height\": " + std::to_string(height) + ", \"spp\": " + std::to_string(spp) +
+		", \"seed\": " + std::to_string(seed) + ", \"maxDepth\": " + std::to_string(maxDepth) + ", \"rouletteDepth\": " + std::to_string(cam.rouletteDepth) +
+		", \"repeat\": " + std::to_string(repeat) + ", \"integrator\": \"path\", \"sampler\": \"sobol\", \"accelerator\": \"WideBVH\" },\n";
+	json += "  \"scenes\": [\n";
+	for (size_t k = 0; k < results.size(); k++)
+	{
+		const BenchResult& r = results[k];
+		double seconds = r.MedianMs() / 1000;
+		char numbers[512];
+		snprintf(numbers, sizeof(numbers),
+			"\"buildMs\": %.3f, \"medianMs\": %.3f, \"bestMs\": %.3f, \"samples\": %lld, \"rays\": %lld, \"raysPerSecond\": %.0f, \"samplesPerSecond\": %.0f",
+			r.buildMs, r.MedianMs(), r.BestMs(), r.stats.samples, r.stats.rays, r.stats.rays / seconds, r.stats.samples / seconds);
+		json += "    { \"name\": " + Json(r.name) + ", \"objects\": " + std::to_string(r.objects) + ", " + numbers + ",\n";
+		json += "      \"renderMs\": [";
+		for (size_t i = 0; i < r.renderMs.size(); i++)
+		{
+			snprintf(numbers, sizeof(numbers), "%s%.3f", i ? ", " : "", r.renderMs[i]);
+			json += numbers;
+		}
+		json += "],\n      \"raysPerBounce\": [";
+		for (size_t b = 0; b < r.stats.raysPerBounce.size(); b++) json += (b ? ", " : "") + std::to_string(r.stats.raysPerBounce[b]);
+		snprintf(numbers, sizeof(numbers), "%.3f", r.stats.Imbalance());
+		json += std::string("], \"imbalance\": ") + numbers;
+#if SPEEDTRACER_COUNTERS
+		json += ",\n      \"counters\": " + r.stats.counters.Json();
+#endif
+		json += std::string(" }") + (k + 1 < results.size() ? "," : "") + "\n";
+	}
+	json += "  ]\n}\n";
+
+	if (jsonPath.empty())
+	{
+		fputs(json.c_str(), stdout);
+		return 0;
+	}
+
+	FILE* file = fopen(jsonPath.c_str(), "wb");
+	if (!file || fputs(json.c_str(), file) < 0)
+	{
+		fprintf(stderr, "Could not write %s\n", jsonPath.c_str());
+		if (file) fclose(file);
+		return 1;
+	}
+	fclose(file);
+
+	printf("%-16s %8s %10s %10s %12s %12s\n", "scene", "objects", "build ms", "median ms", "Mrays/s", "Msamples/s");
+	for (const BenchResult& r : results)
+	{
+		double seconds = r.MedianMs() / 1000;
+		printf("%-16s %8d %10.2f %10.1f %12.2f %12.3f\n", r.name.c_str(), r.objects, r.buildMs, r.MedianMs(), r.stats.rays / seconds / 1e6,
+			r.stats.samples / seconds / 1e6);
+	}
+	return 0;
+}
@@ -0,0 +1,834 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Utils.h"
+#include "Scenes.h"
+#include "Camera.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Progressive.h"
+#include "Sequence.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Wall time of f() in milliseconds
+template<typename F>
+double TimeMs(F&& f)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	f();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/// <summary>
+/// Renders LotsOBalls() at growing sphere counts with the linear Scene loop and with a BVH.
+/// </summary>
+int BenchmarkBVH()
+{
+	const int counts[] = { 24, 1000, 10000, 100000 };
+
+	Camera cam(320, 180, 1);
+	cam.outputPath = "";
+
+	printf("\n%10s %12s %12s %12s %9s\n", "spheres", "linear ms", "build ms", "bvh ms", "speedup");
+	for (int count : counts)
+	{
+		Scene scene = LotsOBalls(count);
+
+		double linearMs = TimeMs([&]() { free(cam.Render(scene, scene.materials)); });
+
+		std::unique_ptr<BVH> bvh;
+		double buildMs = TimeMs([&]() { bvh.reset(new BVH(scene.objects)); });
+		double bvhMs = TimeMs([&]() { free(cam.Render(*bvh, scene.materials)); });
+
+		printf("%10d %12.1f %12.1f %12.1f %8.1fx\n", count, linearMs, buildMs, bvhMs, linearMs / bvhMs);
+	}
+	return 0;
+}
+
+// Casts every ray against object and returns millions of rays per second
+double MeasureMrays(const RenderedObject& object, const std::vector<Ray>& rays, int& hits)
+{
+	hits = 0;
+	double ms = TimeMs([&]()
+	{
+		for (const Ray& r : rays)
+		{
+			HitInfo hit;
+			if (object.CheckHit(r, Interval(0.003, infinity), hit)) hits++;
+		}
+	});
+	return rays.size() / (ms * 1000.0);
+}
+
+/// <summary>
+/// Single threaded ray casting through the binary BVH and the wide BVH with the scalar and the
+/// compiled in SIMD slab test.
+/// </summary>
+int BenchmarkWideBVH()
+{
+	const int counts[] = { 1000, 10000, 100000 };
+	const int rayCount = 1000000;
+
+	printf("\nWide BVH: %d children per node, %s slab test\n", WideBVH::width, SimdName());
+	printf("%10s %14s %14s %14s %9s\n", "spheres", "binary Mray/s", "scalar Mray/s", "simd Mray/s", "speedup");
+	for (int count : counts)
+	{
+		Scene scene = LotsOBalls(count);
+		AABB bounds = scene.BoundingBox();
+
+		// Half camera rays from the origin, half incoherent rays between random points in the scene
+		std::vector<Ray> rays;
+		rays.reserve(rayCount);
+		for (int i = 0; i < rayCount / 2; i++)
+		{
+			rays.push_back(Ray(Vec3(0, 0, 0), Vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 1)));
+		}
+		for (int i = rayCount / 2; i < rayCount; i++)
+		{
+			Vec3 from(RandomDouble(bounds.min.X(), bounds.max.X()), RandomDouble(bounds.min.Y(), bounds.max.Y()), RandomDouble(bounds.min.Z(), bounds.max.Z()));
+			rays.push_back(Ray(from, RandomVec3(-1, 1)));
+		}
+
+		BVH bvh(scene.objects);
+		WideBVH wide(scene.objects);
+
+		int binaryHits, scalarHits, simdHits;
+		double binary = MeasureMrays(bvh, rays, binaryHits);
+		wide.useSimd = false;
+		double scalar = MeasureMrays(wide, rays, scalarHits);
+		wide.useSimd = true;
+		double simd = MeasureMrays(wide, rays, simdHits);
+
+		printf("%10d %14.2f %14.2f %14.2f %8.2fx\n", count, binary, scalar, simd, simd / scalar);
+		if (binaryHits != scalarHits || binaryHits != simdHits)
+			printf("Warning: hit counts differ (binary %d, scalar %d, simd %d)\n", binaryHits, scalarHits, simdHits);
+	}
+	return 0;
+}
+
+/// <summary>
+/// Single threaded ray casting through LotsOBalls() with the virtual Sphere loop and the packed
+/// SphereSoA store with the scalar and the compiled in SIMD kernel.
+/// </summary>
+int BenchmarkSphereStore()
+{
+	const int counts[] = { 24, 256, 4096 };
+	const int rayCount = 200000;
+
+	printf("\nSphere store: %d spheres per step, %s kernel\n", simdWidth, SimdName());
+	printf("%10s %14s %14s %14s %9s\n", "spheres", "object Mray/s", "scalar Mray/s", "simd Mray/s", "speedup");
+	for (int count : counts)
+	{
+		Scene scene = LotsOBalls(count);
+
+		std::vector<Ray> rays;
+		rays.reserve(rayCount);
+		for (int i = 0; i < rayCount; i++)
+		{
+			rays.push_back(Ray(Vec3(0, 0, 0), Vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 1)));
+		}
+
+		int objectHits, scalarHits, simdHits;
+		double object = MeasureMrays(scene, rays, objectHits);
+		scene.PackSpheres();
+		scene.sphereStore->useSimd = false;
+		double scalar = MeasureMrays(scene, rays, scalarHits);
+		scene.sphereStore->useSimd = true;
+		double simd = MeasureMrays(scene, rays, simdHits);
+
+		printf("%10d %14.2f %14.2f %14.2f %8.2fx\n", count, object, scalar, simd, simd / object);
+		if (objectHits != scalarHits || objectHits != simdHits)
+			printf("Warning: hit counts differ (object %d, scalar %d, simd %d)\n", objectHits, scalarHits, simdHits);
+	}
+	return 0;
+}
+
+/// <summary>
+/// Renders with single rays and with 2x2, 4x4 and 8x8 primary ray packets. The primary only
+/// rows (one bounce) isolate the part packets speed up.
+/// </summary>
+int BenchmarkPackets()
+{
+	const int packetSizes[] = { 0, 2, 4, 8 };
+	struct Case
+	{
+		const char* name;
+		Scene scene;
+	};
+	Case cases[] = { { "SampleScene", SampleScene() }, { "LotsOBalls 10k", LotsOBalls(10000) } };
+
+	Camera cam(640, 360, 1);
+	cam.outputPath = "";
+
+	printf("\n%-16s %8s %10s %10s %10s %10s\n", "scene", "bounces", "single ms", "2x2 ms", "4x4 ms", "8x8 ms");
+	for (Case& c : cases)
+	{
+		WideBVH bvh(c.scene.objects);
+		for (int bounces : { 1, 4 })
+		{
+			cam.maxRays = bounces;
+			printf("%-16s %8d", c.name, bounces);
+			for (int packetSize : packetSizes)
+			{
+				cam.packetSize = packetSize;
+				printf(" %10.1f", TimeMs([&]() { free(cam.Render(bvh, c.scene.materials)); }));
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Samples per second of the path loop and the wavefront integrator on every scene.
+/// </summary>
+int BenchmarkIntegrators()
+{
+	struct Case
+	{
+		const char* name;
+		Scene scene;
+	};
+	Case cases[] = {
+		{ "TestScene", TestScene() },
+		{ "SampleScene", SampleScene() },
+		{ "BasicScene", BasicScene() },
+		{ "Room", Room() },
+		{ "LotsOBalls", LotsOBalls() },
+		{ "LotsOBalls 10k", LotsOBalls(10000) }
+	};
+
+	Camera cam(320, 180, 8);
+	cam.outputPath = "";
+	double samples = double(cam.imageWidth) * cam.imageHeight * cam.samplesPerPixel;
+
+	printf("\n%-16s %16s %16s %9s\n", "scene", "path Ms/s", "wavefront Ms/s", "speedup");
+	for (Case& c : cases)
+	{
+		WideBVH bvh(c.scene.objects);
+
+		cam.integrator = Integrator::Path;
+		double path = samples / (TimeMs([&]() { free(cam.Render(bvh, c.scene.materials)); }) * 1000.0);
+		cam.integrator = Integrator::Wavefront;
+		double wavefront = samples / (TimeMs([&]() { free(cam.Render(bvh, c.scene.materials)); }) * 1000.0);
+
+		printf("%-16s %16.3f %16.3f %8.2fx\n", c.name, path, wavefront, wavefront / path);
+	}
+	return 0;
+}
+
+/// <summary>
+/// Render time with 1, 2, 4, ... workers up to every hardware thread, with the speedup and
+/// parallel efficiency over one worker, the pool's utilization and how many tiles were stolen.
+/// Then the cost of starting threads per frame against reusing the camera's pool.
+/// </summary>
+int BenchmarkScaling()
+{
+	struct Case
+	{
+		const char* name;
+		Scene scene;
+	};
+	Case cases[] = { { "SampleScene", SampleScene() }, { "LotsOBalls 10k", LotsOBalls(10000) } };
+
+	int hardwareThreads = std::max(1, int(std::thread::hardware_concurrency()));
+	std::vector<int> threadCounts;
+	for (int t = 1; t < hardwareThreads; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(hardwareThreads);
+
+	Camera cam(640, 360, 4);
+	cam.outputPath = "";
+
+	printf("\n%d hardware threads, %dx%d tiles\n", hardwareThreads, cam.tileSize, cam.tileSize);
+	printf("%-16s %8s %7s %10s %9s %11s %8s %8s\n", "scene", "threads", "pinned", "ms", "speedup", "efficiency", "util", "stolen");
+	for (Case& c : cases)
+	{
+		WideBVH bvh(c.scene.objects);
+		for (bool pinned : { false, true })
+		{
+			cam.pinThreads = pinned;
+			double baseMs = 0;
+			for (int threads : threadCounts)
+			{
+				cam.threadCount = threads;
+				double ms = TimeMs([&]() { free(cam.Render(bvh, c.scene.materials)); });
+				if (threads == 1) baseMs = ms;
+				printf("%-16s %8d %7s %10.1f %8.2fx %10.0f%% %7.0f%% %8d\n", c.name, threads, cam.PoolStats().pinned ? "yes" : "no",
+					ms, baseMs / ms, 100.0 * baseMs / (ms * threads), 100.0 * cam.PoolStats().lastUtilization, cam.tilesStolen);
+			}
+		}
+	}
+
+	// Tiny frames where thread startup is a real part of the frame time
+	const int frames = 200;
+	Scene scene = SampleScene();
+	double freshMs = TimeMs([&]()
+	{
+		for (int f = 0; f < frames; f++)
+		{
+			Camera frameCam(64, 36, 1);
+			frameCam.outputPath = "";
+			free(frameCam.Render(scene, scene.materials));
+		}
+	});
+	Camera reused(64, 36, 1);
+	reused.outputPath = "";
+	double reusedMs = TimeMs([&]() { for (int f = 0; f < frames; f++) free(reused.Render(scene, scene.materials)); });
+	printf("\n%d frames of 64x36: new threads per frame %.1f ms, reused pool %.1f ms\n", frames, freshMs, reusedMs);
+	return 0;
+}
+
+// HitInfo as it was before the material table, for BenchmarkMaterialRefs()
+struct SharedMaterialHit
+{
+	Vec3 p;
+	Vec3 normal;
+	double t;
+	bool frontFace;
+	shared_ptr<Material> mat;
+};
+
+/// <summary>
+/// Runs the closest hit bookkeeping of Scene::CheckHit (fill a temporary hit, copy it over the
+/// closest one) on every thread, with setMaterial storing the material in the temporary.
+/// Returns millions of hit updates per second over all threads.
+/// </summary>
+template<typename Hit, typename SetMaterial>
+double MeasureHitUpdates(int threads, SetMaterial setMaterial, double& checksum)
+{
+	const int raysPerThread = 2000000;
+	const int candidates = 8;
+	std::vector<double> sums(threads);
+	std::vector<long long> updates(threads);
+
+	double ms = TimeMs([&]()
+	{
+		std::vector<std::thread> workers;
+		for (int w = 0; w < threads; w++)
+		{
+			workers.emplace_back([&, w]()
+			{
+				Hit hit, tempHit;
+				hit.t = tempHit.t = 0;
+				double sum = 0;
+				long long count = 0;
+				for (int r = 0; r < raysPerThread; r++)
+				{
+					double closestSoFar = infinity;
+					for (int k = 0; k < candidates; k++)
+					{
+						// Hit distances in a scrambled order so most rays update more than once
+						double t = double((r * 7 + k * 13 + w) % 17);
+						if (t >= closestSoFar) continue;
+						tempHit.t = t;
+						setMaterial(tempHit, (r + k) % 4);
+						hit = tempHit;
+						closestSoFar = t;
+						count++;
+					}
+					sum += hit.t;
+				}
+				sums[w] = sum;
+				updates[w] = count;
+			});
+		}
+		for (auto& t : workers) t.join();
+	});
+
+	long long total = 0;
+	for (int w = 0; w < threads; w++)
+	{
+		checksum += sums[w];
+		total += updates[w];
+	}
+	return total / (ms * 1000.0);
+}
+
+/// <summary>
+/// Hit updates per second with the material held as a shared_ptr (an atomic refcount bump on a
+/// handful of control blocks every thread shares) and as a 32 bit table index.
+/// </summary>
+int BenchmarkMaterialRefs()
+{
+	std::vector<shared_ptr<Material>> shared;
+	for (int i = 0; i < 4; i++) shared.push_back(make_shared<Lambertian>(Vec3(0.5, 0.5, 0.5)));
+
+	int hardwareThreads = std::max(1, int(std::thread::hardware_concurrency()));
+	std::vector<int> threadCounts;
+	for (int t = 1; t < hardwareThreads; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(hardwareThreads);
+
+	double checksum = 0;
+	double sharedBase = 0, indexBase = 0;
+	printf("\n%8s %18s %9s %18s %9s\n", "threads", "shared_ptr Mhit/s", "scaling", "index Mhit/s", "scaling");
+	for (int threads : threadCounts)
+	{
+		double sharedRate = MeasureHitUpdates<SharedMaterialHit>(threads,
+			[&](SharedMaterialHit& hit, int id) { hit.mat = shared[id]; }, checksum);
+		double indexRate = MeasureHitUpdates<HitInfo>(threads,
+			[&](HitInfo& hit, int id) { hit.materialId = uint32_t(id); }, checksum);
+		if (threads == 1)
+		{
+			sharedBase = sharedRate;
+			indexBase = indexRate;
+		}
+		printf("%8d %18.1f %8.2fx %18.1f %8.2fx\n", threads, sharedRate, sharedRate / sharedBase, indexRate, indexRate / indexBase);
+	}
+	printf("(checksum %.0f)\n", checksum);
+	return 0;
+}
+
+// Mean 8 bit value over every channel of an image from Camera::Render
+double MeanPixel(const uint8_t* image, const Camera& cam)
+{
+	double sum = 0;
+	int count = cam.imageWidth * cam.imageHeight * 3;
+	for (int i = 0; i < count; i++) sum += image[i];
+	return sum / count;
+}
+
+/// <summary>
+/// Render time at growing bounce limits with Russian roulette off and on. The mean pixel value
+/// should stay the same, roulette only trades dim bounces for noise.
+/// </summary>
+int BenchmarkRoulette()
+{
+	struct Case
+	{
+		const char* name;
+		Scene scene;
+	};
+	Case cases[] = { { "SampleScene", SampleScene() }, { "Room", Room() }, { "LotsOBalls", LotsOBalls() } };
+	const int depths[] = { 4, 8, 16, 32 };
+
+	Camera cam(320, 180, 8);
+	cam.outputPath = "";
+
+	printf("\n%-12s %8s %10s %10s %9s %10s %10s\n", "scene", "bounces", "off ms", "on ms", "speedup", "off mean", "on mean");
+	for (Case& c : cases)
+	{
+		WideBVH bvh(c.scene.objects);
+		for (int depth : depths)
+		{
+			cam.maxRays = depth;
+			double mean[2], ms[2];
+			for (int roulette = 0; roulette < 2; roulette++)
+			{
+				cam.rouletteDepth = roulette ? 3 : depth;
+				uint8_t* image = nullptr;
+				ms[roulette] = TimeMs([&]() { image = cam.Render(bvh, c.scene.materials); });
+				mean[roulette] = MeanPixel(image, cam);
+				free(image);
+			}
+			printf("%-12s %8d %10.1f %10.1f %8.2fx %10.2f %10.2f\n", c.name, depth, ms[0], ms[1], ms[0] / ms[1], mean[0], mean[1]);
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Millions of random numbers per second from the old mt19937 + uniform_real_distribution pair,
+/// scalar Pcg32, the SIMD Pcg32Wide and each SamplerType the renderer can draw from.
+/// </summary>
+int BenchmarkRng()
+{
+	const int count = 20000000;
+	double sum = 0;
+
+	std::mt19937 mersenne(1234);
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	double mersenneMs = TimeMs([&]() { for (int i = 0; i < count; i++) sum += dist(mersenne); });
+
+	Pcg32 pcg(1234);
+	double pcgMs = TimeMs([&]() { for (int i = 0; i < count; i++) sum += pcg.NextDouble(); });
+
+	Pcg32Wide wide(1234);
+	double wideMs = TimeMs([&]()
+	{
+		alignas(32) float values[simdWidth];
+		for (int i = 0; i < count; i += simdWidth)
+		{
+			wide.NextFloats(values);
+			for (int lane = 0; lane < simdWidth; lane++) sum += values[lane];
+		}
+	});
+
+	struct SamplerCase
+	{
+		const char* name;
+		SamplerType type;
+		double ms;
+	};
+	SamplerCase samplers[] = {
+		{ "Sampler independent", SamplerType::Independent, 0 },
+		{ "Sampler sobol", SamplerType::Sobol, 0 },
+		{ "Sampler blue noise", SamplerType::BlueNoise, 0 }
+	};
+	for (SamplerCase& c : samplers)
+	{
+		Sampler sampler(1234, c.type);
+		// A camera sample's worth of dimensions per sample, like the renderer draws them
+		c.ms = TimeMs([&]()
+		{
+			for (int i = 0; i < count; i += 4)
+			{
+				sampler.StartSample(i & 255, (i >> 8) & 255, uint32_t(i >> 16));
+				for (int d = 0; d < 4; d++) sum += sampler.Next();
+			}
+		});
+	}
+
+	printf("\n%-24s %12s\n", "generator", "M/s");
+	printf("%-24s %12.1f\n", "mt19937", count / (mersenneMs * 1000.0));
+	printf("%-24s %12.1f\n", "Pcg32", count / (pcgMs * 1000.0));
+	printf("%-24s %12.1f   (%d lanes, %s)\n", "Pcg32Wide", count / (wideMs * 1000.0), simdWidth, SimdName());
+	for (const SamplerCase& c : samplers) printf("%-24s %12.1f\n", c.name, count / (c.ms * 1000.0));
+	printf("(mean %.4f)\n", sum / (6.0 * count));
+	return 0;
+}
+
+// Root mean square difference of two radiance buffers
+double RadianceRmse(const std::vector<float>& a, const std::vector<float>& b)
+{
+	double sum = 0;
+	for (size_t i = 0; i < a.size(); i++) sum += double(a[i] - b[i]) * (a[i] - b[i]);
+	return sqrt(sum / a.size());
+}
+
+/// <summary>
+/// Error of TestScene() at 1 to 64 samples per pixel against a 4096 sample reference, for each
+/// SamplerType. gain is (independent RMSE / sampler RMSE)^2: how many times more independent
+/// samples the same error would take, since Monte Carlo error falls with the square root of the
+/// sample count.
+/// </summary>
+int BenchmarkConvergence()
+{
+	Scene scene = TestScene();
+	WideBVH bvh(scene.objects);
+	Camera cam(96, 54, 4096);
+	cam.outputPath = "";
+	cam.samplerType = SamplerType::Independent;
+	cam.seed = 9999;
+	free(cam.Render(bvh, scene.materials));
+	std::vector<float> reference = cam.radiance;
+
+	struct SamplerCase
+	{
+		const char* name;
+		SamplerType type;
+	};
+	const SamplerCase samplers[] = {
+		{ "independent", SamplerType::Independent },
+		{ "sobol", SamplerType::Sobol },
+		{ "blue noise", SamplerType::BlueNoise }
+	};
+	const int seeds = 4;
+
+	printf("\n%6s", "spp");
+	for (const SamplerCase& c : samplers) printf(" %12s", c.name);
+	for (int k = 1; k < 3; k++) printf(" %10s", (std::string(samplers[k].name) + " gain").c_str());
+	printf("\n");
+
+	for (int spp = 1; spp <= 64; spp *= 2)
+	{
+		cam.samplesPerPixel = spp;
+		double rmse[3];
+		for (int k = 0; k < 3; k++)
+		{
+			cam.samplerType = samplers[k].type;
+			// Averaged over a few seeds so one lucky scramble doesn't decide the row
+			rmse[k] = 0;
+			for (int seed = 1; seed <= seeds; seed++)
+			{
+				cam.seed = uint32_t(seed);
+				free(cam.Render(bvh, scene.materials));
+				rmse[k] += RadianceRmse(cam.radiance, reference) / seeds;
+			}
+		}
+		printf("%6d %12.5f %12.5f %12.5f %10.2fx %10.2fx\n", spp, rmse[0], rmse[1], rmse[2],
+			(rmse[0] / rmse[1]) * (rmse[0] / rmse[1]), (rmse[0] / rmse[2]) * (rmse[0] / rmse[2]));
+	}
+	return 0;
+}
+
+// Mean of (a - b)^2 / (b^2 + 0.01) over the channels, error relative to the reference brightness
+double RadianceRelMse(const std::vector<float>& a, const std::vector<float>& b)
+{
+	double sum = 0;
+	for (size_t i = 0; i < a.size(); i++) sum += double(a[i] - b[i]) * (a[i] - b[i]) / (double(b[i]) * b[i] + 0.01);
+	return sum / a.size();
+}
+
+/// <summary>
+/// Adaptive sampling against a fixed sample count with the same total samples, on TestScene()
+/// and SampleScene(): time, mean spp, RMSE and relMSE against a 1024 sample reference. Saves where the
+/// samples went as samples_testscene.png and samples_samplescene.png.
+/// </summary>
+int BenchmarkAdaptive()
+{
+	struct Case
+	{
+		const char* name;
+		const char* mapPath;
+		Scene (*make)();
+	};
+	const Case cases[] = {
+		{ "TestScene", "samples_testscene.png", TestScene },
+		{ "SampleScene", "samples_samplescene.png", SampleScene }
+	};
+
+	printf("\n%-12s %-10s %8s %10s %10s %10s\n", "scene", "mode", "ms", "mean spp", "RMSE", "relMSE");
+	for (const Case& c : cases)
+	{
+		Scene scene = c.make();
+		WideBVH bvh(scene.objects);
+		Camera cam(160, 90, 1024);
+		cam.outputPath = "";
+		cam.seed = 9999;
+		free(cam.Render(bvh, scene.materials));
+		std::vector<float> reference = cam.radiance;
+		cam.seed = 1;
+
+		cam.adaptiveSampling = true;
+		cam.samplesPerPixel = 4;
+		cam.maxSamplesPerPixel = 256;
+		double adaptiveMs = TimeMs([&]() { free(cam.Render(bvh, scene.materials)); });
+		double meanSpp = 0;
+		for (int count : cam.sampleCounts) meanSpp += count;
+		meanSpp /= cam.sampleCounts.size();
+		double adaptiveRmse = RadianceRmse(cam.radiance, reference);
+		double adaptiveRel = RadianceRelMse(cam.radiance, reference);
+		cam.WriteSampleMap(c.mapPath);
+
+		cam.adaptiveSampling = false;
+		cam.samplesPerPixel = std::max(1, int(meanSpp + 0.5));
+		double fixedMs = TimeMs([&]() { free(cam.Render(bvh, scene.materials)); });
+		double fixedRmse = RadianceRmse(cam.radiance, reference);
+		double fixedRel = RadianceRelMse(cam.radiance, reference);
+
+		printf("%-12s %-10s %8.1f %10.1f %10.5f %10.5f\n", c.name, "fixed", fixedMs, double(cam.samplesPerPixel), fixedRmse, fixedRel);
+		printf("%-12s %-10s %8.1f %10.1f %10.5f %10.5f\n", c.name, "adaptive", adaptiveMs, meanSpp, adaptiveRmse, adaptiveRel);
+	}
+	return 0;
+}
+
+/// <summary>
+/// Progressive rendering of SampleScene(): when each pass became viewable and its RMSE against a
+/// 16 sample Render(), which the 16th pass should match up to float rounding. Also stops a second
+/// run part way through a pass to show the partial result stays a valid estimate.
+/// </summary>
+int BenchmarkProgressive()
+{
+	Scene scene = SampleScene();
+	WideBVH bvh(scene.objects);
+	const int passes = 16;
+	Camera cam(480, 270, passes);
+	cam.outputPath = "";
+
+	double renderMs = TimeMs([&]() { free(cam.Render(bvh, scene.materials)); });
+	std::vector<float> reference = cam.radiance;
+
+	auto estimate = [&](const std::vector<float>& accum)
+	{
+		std::vector<float> rgb(reference.size());
+		for (size_t p = 0; p < rgb.size() / 3; p++)
+			for (int c = 0; c < 3; c++) rgb[p * 3 + c] = accum[p * 4 + 3] > 0 ? accum[p * 4 + c] / accum[p * 4 + 3] : 0.0f;
+		return rgb;
+	};
+
+	printf("\nRender() with %d spp: %.1f ms\n", passes, renderMs);
+	printf("%6s %10s %10s\n", "pass", "ms", "RMSE");
+	auto start = std::chrono::high_resolution_clock::now();
+	{
+		ProgressiveRender progressive(cam, bvh, scene.materials, passes);
+		progressive.Start();
+		int shown = 0;
+		while (shown < passes)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (progressive.Passes() == shown) continue;
+			shown = progressive.Passes();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			printf("%6d %10.1f %10.5f\n", shown, ms, RadianceRmse(estimate(progressive.Accumulation()), reference));
+		}
+	}
+
+	ProgressiveRender stopped(cam, bvh, scene.materials);
+	stopped.Start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(int(renderMs / passes * 2.5)));
+	stopped.Stop();
+	std::vector<float> accum = stopped.Accumulation();
+	float fewest = accum[3], most = accum[3];
+	for (size_t p = 3; p < accum.size(); p += 4)
+	{
+		fewest = std::min(fewest, accum[p]);
+		most = std::max(most, accum[p]);
+	}
+	printf("stopped after %d full passes, pixels hold %g to %g samples, RMSE %.5f\n", stopped.Passes(), fewest, most,
+		RadianceRmse(estimate(accum), reference));
+	return 0;
+}
+
+/// <summary>
+/// Render and denoise time at 4 and 8 samples per pixel, and the RMSE of the raw and the
+/// denoised image against a 1024 sample reference. Saves both versions of the 4 sample image of
+/// each scene as denoise_<scene>_noisy.png and denoise_<scene>_filtered.png.
+/// </summary>
+int BenchmarkDenoise()
+{
+	struct Case
+	{
+		const char* name;
+		Scene (*make)();
+	};
+	const Case cases[] = {
+		{ "testscene", TestScene },
+		{ "samplescene", SampleScene }
+	};
+
+	printf("\n%-12s %4s %10s %10s %12s %12s\n", "scene", "spp", "render ms", "denoise ms", "raw RMSE", "denoised RMSE");
+	for (const Case& c : cases)
+	{
+		Scene scene = c.make();
+		WideBVH bvh(scene.objects);
+		Camera cam(480, 270, 1024);
+		cam.outputPath = "";
+		cam.seed = 9999;
+		free(cam.Render(bvh, scene.materials));
+		std::vector<float> reference = cam.radiance;
+		cam.seed = 1;
+
+		for (int spp : { 4, 8 })
+		{
+			cam.samplesPerPixel = spp;
+			cam.denoise = false;
+			if (spp == 4) cam.outputPath = std::string("denoise_") + c.name + "_noisy.png";
+			double renderMs = TimeMs([&]() { free(cam.Render(bvh, scene.materials)); });
+			double rawRmse = RadianceRmse(cam.radiance, reference);
+
+			// Same samples again with the guides, timing only the filter
+			cam.denoise = true;
+			if (spp == 4) cam.outputPath = std::string("denoise_") + c.name + "_filtered.png";
+			free(cam.Render(bvh, scene.materials));
+			cam.outputPath = "";
+			std::vector<float> noisy(cam.radiance.size());
+			cam.denoise = false;
+			free(cam.Render(bvh, scene.materials));
+			noisy = cam.radiance;
+			double denoiseMs = TimeMs([&]() { cam.denoiser.Run(cam.Pool(), cam.imageWidth, cam.imageHeight, noisy, cam.aovs); });
+			double denoisedRmse = RadianceRmse(noisy, reference);
+
+			printf("%-12s %4d %10.1f %10.1f %12.5f %12.5f\n", c.name, spp, renderMs, denoiseMs, rawRmse, denoisedRmse);
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Time to save a 3840x2160 render of SampleScene(): stb_image_write on one thread, the strip PNG
+/// encoder on one thread and on every hardware thread, QOI and PPM, with the file sizes. Then how
+/// long Render() takes to return with asyncOutput on and off.
+/// </summary>
+int BenchmarkOutput()
+{
+	Scene scene = SampleScene();
+	WideBVH bvh(scene.objects);
+	Camera cam(3840, 2160, 1);
+	cam.outputPath = "";
+	uint8_t* image = cam.Render(bvh, scene.materials);
+	const int w = cam.imageWidth, h = cam.imageHeight;
+
+	auto fileSize = [](const char* path)
+	{
+		FILE* file = fopen(path, "rb");
+		if (!file) return 0L;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fclose(file);
+		return size;
+	};
+	auto queued = [&](const char* path, int threads)
+	{
+		return TimeMs([&]()
+		{
+			EncodeQueue queue(threads);
+			uint8_t* copy = (uint8_t*)malloc(size_t(w) * h * 3);
+			memcpy(copy, image, size_t(w) * h * 3);
+			queue.Push(path, w, h, copy);
+			queue.Finish();
+		});
+	};
+
+	int threads = std::max(1, int(std::thread::hardware_concurrency()));
+	printf("\n%-26s %10s %12s\n", "3840x2160", "ms", "bytes");
+	double ms = TimeMs([&]() { stbi_write_png("output_stb.png", w, h, 3, image, w * 3); });
+	printf("%-26s %10.1f %12ld\n", "stb_image_write png", ms, fileSize("output_stb.png"));
+	ms = queued("output_strips.png", 1);
+	printf("%-26s %10.1f %12ld\n", "strip png, 1 thread", ms, fileSize("output_strips.png"));
+	ms = queued("output_strips.png", threads);
+	std::string label = "strip png, " + std::to_string(threads) + " threads";
+	printf("%-26s %10.1f %12ld\n", label.c_str(), ms, fileSize("output_strips.png"));
+	ms = queued("output.qoi", 1);
+	printf("%-26s %10.1f %12ld\n", "qoi", ms, fileSize("output.qoi"));
+	ms = queued("output.ppm", 1);
+	printf("%-26s %10.1f %12ld\n", "ppm", ms, fileSize("output.ppm"));
+	free(image);
+
+	cam.outputPath = "output_strips.png";
+	for (bool async : { false, true })
+	{
+		cam.asyncOutput = async;
+		double renderMs = TimeMs([&]() { free(cam.Render(bvh, scene.materials)); });
+		double totalMs = renderMs + TimeMs([&]() { cam.WaitForOutput(); });
+		printf("Render() with asyncOutput %-5s returns after %8.1f ms, file written after %8.1f ms\n", async ? "on" : "off", renderMs, totalMs);
+	}
+	return 0;
+}
+
+/// <summary>
+/// A 24 frame turntable of SampleScene() at 1280x720 saved as sequence_NNNN.png, first the way a
+/// loop over Render() does it (fresh camera and pool per frame, PNG written before Render() returns), then
+/// with SequenceRenderer reusing everything and encoding on background threads.
+/// </summary>
+int BenchmarkSequence()
+{
+	Scene scene = SampleScene();
+	WideBVH bvh(scene.objects);
+	const int frames = 24;
+	auto path = OrbitPath(Vec3(0, 0, 1.2), 3, 0.5, frames);
+	SequenceRenderer sequence;
+	sequence.outputPattern = "sequence_%04d.png";
+
+	double serialMs = TimeMs([&]()
+	{
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Camera cam(1280, 720, 4);
+			CameraPose pose = path(frame);
+			cam.cameraCenter = pose.position;
+			cam.cameraRotation = pose.rotation;
+			cam.outputPath = sequence.FramePath(frame);
+			cam.asyncOutput = false;
+			free(cam.Render(bvh, scene.materials));
+		}
+	});
+
+	Camera cam(1280, 720, 4);
+	double pipelinedMs = TimeMs([&]() { sequence.Render(cam, bvh, scene.materials, frames, path); });
+
+	printf("\n%d frames, %d render threads, %d encode threads\n", frames, cam.Pool().WorkerCount(), sequence.encodeThreads);
+	printf("%-10s %10s %12s\n", "", "total ms", "ms / frame");
+	printf("%-10s %10.1f %12.1f\n", "serial", serialMs, serialMs / frames);
+	printf("%-10s %10.1f %12.1f   (%.1f ms rendering, %.1f ms waiting for encoders)\n", "pipelined", pipelinedMs, pipelinedMs / frames,
+		sequence.renderSeconds * 1000, sequence.stallSeconds * 1000);
+	return 0;
+}
+
+#endif
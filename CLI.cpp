@@ -0,0 +1,210 @@
+// Headless batch renderer: the CPU tracer without a window, GL context or shaders.
+// Build with CMake (target SpeedTracerCLI), which defines SPEEDTRACER_HEADLESS.
+#include "Utils.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Scene.h"
+#include "Camera.h"
+#include "WideBVH.h"
+#include "Sequence.h"
+#include "Scenes.h"
+#include "Verify.h"
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: SpeedTracerCLI [options]\n"
+		"  --scene NAME        test, sample, basic, room or balls (default sample)\n"
+		"  --width N           image width (default 1920)\n"
+		"  --height N          image height (default 1080)\n"
+		"  --spp N             samples per pixel (default 16)\n"
+		"  --threads N         render threads, 0 for every hardware thread (default 0)\n"
+		"  --seed N            random seed, also fixes the balls layout (default 0, balls then use seed 1)\n"
+		"  --output PATH       image to write, .png, .qoi or .ppm (default output.png)\n"
+		"  --hdr PATH          also write the float image, .pfm or a multi layer .exr with AOVs\n"
+		"  --max-depth N       intersections per path (default 4)\n"
+		"  --denoise           filter the image with the a-trous denoiser\n"
+		"  --stats             print the render statistics (ray counters need SPEEDTRACER_COUNTERS)\n"
+		"  --stats-json PATH   write the render statistics as JSON\n"
+		"  --cost-maps         also write per pixel cycle and intersection test heatmaps next to the\n"
+		"                      output (out.png -> out_cycles.png, out_tests.png), single images only\n"
+		"  --trace PATH        write a timeline of tiles, BVH builds and encoding as Chrome trace JSON\n"
+		"                      (open it in ui.perfetto.dev or chrome://tracing)\n"
+		"  --verify-determinism  render with 1, 4 and every thread and check the images match, then exit\n"
+		"Sequences:\n"
+		"  --frames N          render N frames of a turntable around --target; the output name gets\n"
+		"                      the frame number (out.png -> out_0000.png) unless it already has one %%d\n"
+		"                      like out_%%03d.png\n"
+		"  --target X,Y,Z      point the camera circles and looks at (default 0,0,1.2)\n"
+		"  --radius R          distance from the target (default 3)\n"
+		"  --lift H            camera height above the target (default 0.5)\n"
+		"  --encode-threads N  threads saving frames while the next one renders (default every hardware thread)\n");
+}
+
+// Stops the global tracer and writes what it recorded, if --trace asked for it
+static bool FinishTrace(const std::string& path)
+{
+	if (path.empty()) return true;
+	GlobalTracer().Stop();
+	if (GlobalTracer().WriteChromeJson(path)) return true;
+	fprintf(stderr, "Could not write %s\n", path.c_str());
+	return false;
+}
+
+// seed also places the balls, 0 maps to 1 so the layout repeats between runs
+static bool MakeScene(const std::string& name, uint32_t seed, Scene& scene)
+{
+	if (name == "test") scene = TestScene();
+	else if (name == "sample") scene = SampleScene();
+	else if (name == "basic") scene = BasicScene();
+	else if (name == "room") scene = Room();
+	else if (name == "balls") scene = LotsOBalls(24, seed ? seed : 1);
+	else return false;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string sceneName = "sample";
+	std::string outputPath = "output.png";
+	std::string hdrPath;
+	int width = 1920, height = 1080, spp = 16, threads = 0, maxDepth = 4;
+	uint32_t seed = 0;
+	bool denoise = false, printStats = false, costMaps = false;
+	std::string statsPath, tracePath;
+	int frames = 0, encodeThreads = 0;
+	Vec3 target(0, 0, 1.2);
+	double radius = 3, lift = 0.5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--help" || arg == "-h")
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (arg == "--verify-determinism") return VerifyDeterminism();
+		else if (arg == "--denoise") denoise = true;
+		else if (arg == "--stats") printStats = true;
+		else if (arg == "--cost-maps") costMaps = true;
+		else if (!hasValue)
+		{
+			fprintf(stderr, "Missing value or unknown option: %s\n", arg.c_str());
+			PrintUsage();
+			return 2;
+		}
+		else if (arg == "--scene") sceneName = argv[++i];
+		else if (arg == "--width") width = atoi(argv[++i]);
+		else if (arg == "--height") height = atoi(argv[++i]);
+		else if (arg == "--spp") spp = atoi(argv[++i]);
+		else if (arg == "--threads") threads = atoi(argv[++i]);
+		else if (arg == "--seed") seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--output") outputPath = argv[++i];
+		else if (arg == "--hdr") hdrPath = argv[++i];
+		else if (arg == "--stats-json") statsPath = argv[++i];
+		else if (arg == "--trace") tracePath = argv[++i];
+		else if (arg == "--max-depth") maxDepth = atoi(argv[++i]);
+		else if (arg == "--frames") frames = atoi(argv[++i]);
+		else if (arg == "--radius") radius = atof(argv[++i]);
+		else if (arg == "--lift") lift = atof(argv[++i]);
+		else if (arg == "--encode-threads") encodeThreads = atoi(argv[++i]);
+		else if (arg == "--target")
+		{
+			double x, y, z;
+			if (sscanf(argv[++i], "%lf,%lf,%lf", &x, &y, &z) != 3)
+			{
+				fprintf(stderr, "--target wants X,Y,Z\n");
+				return 2;
+			}
+			target = Vec3(x, y, z);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (width <= 0 || height <= 0 || spp <= 0 || threads < 0 || maxDepth < 0 || frames < 0)
+	{
+		fprintf(stderr, "Width, height and spp must be positive, threads, max depth and frames not negative\n");
+		return 2;
+	}
+	if (frames > 0 && outputPath.find('%') != std::string::npos && !IsFramePattern(outputPath))
+	{
+		fprintf(stderr, "--output with --frames takes one %%d (or %%04d) for the frame number, other %% need escaping as %%%%\n");
+		return 2;
+	}
+
+	Scene scene;
+	if (!MakeScene(sceneName, seed, scene))
+	{
+		fprintf(stderr, "Unknown scene: %s\n", sceneName.c_str());
+		PrintUsage();
+		return 2;
+	}
+
+	if (!tracePath.empty())
+	{
+		GlobalTracer().Start();
+		GlobalTracer().NameThread("main");
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	WideBVH bvh(scene.objects);
+
+	Camera cam(width, height, spp);
+	cam.threadCount = threads;
+	cam.seed = seed;
+	cam.maxRays = maxDepth;
+	cam.outputPath = outputPath;
+	cam.hdrOutputPath = hdrPath;
+	cam.denoise = denoise;
+	cam.renderAovs = !hdrPath.empty();
+	cam.costMaps = costMaps && frames == 0;
+
+	if (frames > 0)
+	{
+		SequenceRenderer sequence;
+		sequence.outputPattern = FramePattern(outputPath);
+		sequence.encodeThreads = encodeThreads;
+		bool ok = sequence.Render(cam, bvh, scene.materials, frames, OrbitPath(target, radius, lift, frames));
+		printf("%s %dx%d, %d spp, %d frames: %.1f s (%.1f s rendering, %.1f s waiting for encoders) -> %s\n", sceneName.c_str(), width, height, spp,
+			frames, sequence.totalSeconds, sequence.renderSeconds, sequence.stallSeconds, sequence.outputPattern.c_str());
+		ok = FinishTrace(tracePath) && ok;
+		return ok ? 0 : 1;
+	}
+
+	free(cam.Render(bvh, scene.materials));
+	double renderMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	bool written = cam.WaitForOutput();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+	printf("%s %dx%d, %d spp, %d threads: %.1f ms (%.1f ms rendering) -> %s\n", sceneName.c_str(), width, height, spp, cam.Pool().WorkerCount(), ms,
+		renderMs, outputPath.empty() ? "(no image)" : outputPath.c_str());
+	if (!written) fprintf(stderr, "Could not write %s\n", outputPath.c_str());
+	if (cam.costMaps && !outputPath.empty())
+		printf("cost maps: %s (red at %.0f ticks), %s (red at %.1f tests)\n", SiblingPath(outputPath, "_cycles").c_str(), cam.cycleScale,
+			SiblingPath(outputPath, "_tests").c_str(), cam.testScale);
+
+	if (printStats) cam.stats.Print(stdout);
+	if (!statsPath.empty())
+	{
+		FILE* file = fopen(statsPath.c_str(), "wb");
+		bool saved = file && fprintf(file, "%s\n", cam.stats.Json().c_str()) > 0;
+		if (file) saved = fclose(file) == 0 && saved;
+		if (!saved)
+		{
+			fprintf(stderr, "Could not write %s\n", statsPath.c_str());
+			written = false;
+		}
+	}
+	written = FinishTrace(tracePath) && written;
+	return written ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "Vec3.h"
+#include "Ray.h"
+#include "Interval.h"
+
+class AABB
+{
+public:
+	Vec3 min;
+	Vec3 max;
+
+	AABB() : min(infinity, infinity, infinity), max(-infinity, -infinity, -infinity) {}
+	AABB(const Vec3& min, const Vec3& max) : min(min), max(max) {}
+	AABB(const AABB& a, const AABB& b)
+		: min(std::fmin(a.min.X(), b.min.X()), std::fmin(a.min.Y(), b.min.Y()), std::fmin(a.min.Z(), b.min.Z())),
+		  max(std::fmax(a.max.X(), b.max.X()), std::fmax(a.max.Y(), b.max.Y()), std::fmax(a.max.Z(), b.max.Z())) {}
+
+	void Expand(const AABB& box)
+	{
+		*this = AABB(*this, box);
+	}
+	void Expand(const Vec3& p)
+	{
+		*this = AABB(*this, AABB(p, p));
+	}
+	bool IsEmpty() const
+	{
+		return min.X() > max.X() || min.Y() > max.Y() || min.Z() > max.Z();
+	}
+	Vec3 Centroid() const
+	{
+		return 0.5 * (min + max);
+	}
+	Vec3 Extent() const
+	{
+		return max - min;
+	}
+	double SurfaceArea() const
+	{
+		if (IsEmpty()) return 0;
+		Vec3 d = Extent();
+		return 2 * (d.X() * d.Y() + d.Y() * d.Z() + d.Z() * d.X());
+	}
+	int LongestAxis() const
+	{
+		Vec3 d = Extent();
+		if (d.X() > d.Y() && d.X() > d.Z()) return 0;
+		return d.Y() > d.Z() ? 1 : 2;
+	}
+
+	/// <summary>
+	/// Slab test. invDir is 1 / r.Direction(), precomputed once per ray by the caller.
+	/// </summary>
+	bool CheckHit(const Ray& r, const Vec3& invDir, Interval rayT) const
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double t0 = (min[axis] - r.Origin()[axis]) * invDir[axis];
+			double t1 = (max[axis] - r.Origin()[axis]) * invDir[axis];
+			if (invDir[axis] < 0) std::swap(t0, t1);
+
+			if (t0 > rayT.min) rayT.min = t0;
+			if (t1 < rayT.max) rayT.max = t1;
+			if (rayT.max <= rayT.min) return false;
+		}
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include <cstddef>
+#include <vector>
+
+// Depth stored where the centre ray missed everything
+const float aovMissDepth = 1e6f;
+
+/// <summary>
+/// Arbitrary output variables: float layers Render() fills next to the colour. Everything but
+/// rays comes from the first hit of the unjittered ray through each pixel's centre, so the
+/// layers are free of sampling noise.
+/// </summary>
+struct AovBuffers
+{
+	std::vector<float> normal;		// 3 floats per pixel, (0, 0, -1) where the ray missed
+	std::vector<float> albedo;		// 3 floats per pixel, GuideAlbedo of the material, 1 where the ray missed
+	std::vector<float> depth;		// Distance to the hit, aovMissDepth where the ray missed
+	std::vector<float> materialId;	// Index into the MaterialTable, -1 where the ray missed
+	std::vector<float> rays;		// Rays traced per sample, averaged over the pixel's samples
+
+	void Resize(size_t pixels)
+	{
+		normal.assign(pixels * 3, 0.0f);
+		for (size_t p = 0; p < pixels; p++) normal[p * 3 + 2] = -1.0f;
+		albedo.assign(pixels * 3, 1.0f);
+		depth.assign(pixels, aovMissDepth);
+		materialId.assign(pixels, -1.0f);
+		rays.assign(pixels, 0.0f);
+	}
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "RenderedObject.h"
+#include "AABB.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+
+/// <summary>
+/// Bounding volume hierarchy over a list of objects, built with the surface area heuristic.
+/// Nodes are stored depth first in one array: a node's first child directly follows it
+/// and only the second child's index is stored.
+/// </summary>
+class BVH : public RenderedObject
+{
+public:
+	struct Node
+	{
+		AABB bounds;
+		int offset;			// Leaf: first primitive. Interior: second child.
+		int primitiveCount;	// 0 for interior nodes
+		int axis;			// Split axis of interior nodes
+	};
+
+	std::vector<shared_ptr<RenderedObject>> primitives;
+	std::vector<Node> nodes;
+
+	// Entries in the fixed traversal stacks, here and in WideBVH. Build() stops splitting at
+	// maxDepth, so a root to leaf path, plus the sibling a packet pushes, always fits
+	static const int traversalStackSize = 64;
+	static const int maxDepth = traversalStackSize - 1;
+
+	BVH(const std::vector<shared_ptr<RenderedObject>>& objects, int maxLeafSize = 4) : maxLeafSize(maxLeafSize)
+	{
+		TraceScope trace("BVH build", "build", "objects", (long long)objects.size());
+		Build(objects);
+	}
+
+	bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const override
+	{
+		if (nodes.empty()) return false;
+
+		Vec3 invDir(1.0 / r.Direction().X(), 1.0 / r.Direction().Y(), 1.0 / r.Direction().Z());
+		bool dirIsNeg[3] = { invDir.X() < 0, invDir.Y() < 0, invDir.Z() < 0 };
+
+		bool hasHit = false;
+		int stack[traversalStackSize];
+		int stackSize = 0;
+		int current = 0;
+		while (true)
+		{
+			const Node& node = nodes[current];
+			if (node.bounds.CheckHit(r, invDir, rayT))
+			{
+				if (node.primitiveCount > 0)
+				{
+					for (int i = 0; i < node.primitiveCount; i++)
+					{
+						if (primitives[node.offset + i]->CheckHit(r, rayT, hit))
+						{
+							hasHit = true;
+							rayT.max = hit.t;
+						}
+					}
+					if (stackSize == 0) break;
+					current = stack[--stackSize];
+				}
+				// Visit the child nearer to the ray origin first so its hits shrink rayT sooner
+				else if (dirIsNeg[node.axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+				}
+			}
+			else
+			{
+				if (stackSize == 0) break;
+				current = stack[--stackSize];
+			}
+		}
+		return hasHit;
+	}
+	uint64_t CheckHitPacket(RayPacket& packet, HitInfo hits[]) const override
+	{
+		if (nodes.empty() || packet.size == 0) return 0;
+
+		// The packet is coherent, so the first ray picks the traversal order for all of them
+		const Vec3& d = packet.rays[0].Direction();
+		bool dirIsNeg[3] = { d.X() < 0, d.Y() < 0, d.Z() < 0 };
+
+		struct StackEntry
+		{
+			int node;
+			uint64_t active;
+		};
+		uint64_t hitMask = 0;
+		StackEntry stack[traversalStackSize];
+		int stackSize = 0;
+		stack[stackSize++] = StackEntry{ 0, packet.AllRays() };
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			const Node& node = nodes[entry.node];
+			if (packet.hasFrustum && packet.frustum.Culls(node.bounds)) continue;
+
+			uint64_t active = packet.IntersectBox(node.bounds, entry.active);
+			if (!active) continue;
+
+			if (node.primitiveCount > 0)
+			{
+				for (int i = 0; i < node.primitiveCount; i++)
+				{
+					hitMask |= CheckHitActive(*primitives[node.offset + i], packet, active, hits);
+				}
+			}
+			// Push the far child first so the near one is popped next
+			else if (dirIsNeg[node.axis])
+			{
+				stack[stackSize++] = StackEntry{ entry.node + 1, active };
+				stack[stackSize++] = StackEntry{ node.offset, active };
+			}
+			else
+			{
+				stack[stackSize++] = StackEntry{ node.offset, active };
+				stack[stackSize++] = StackEntry{ entry.node + 1, active };
+			}
+		}
+		return hitMask;
+	}
+	AABB BoundingBox() const override
+	{
+		return nodes.empty() ? AABB() : nodes[0].bounds;
+	}
+
+private:
+	struct BuildPrimitive
+	{
+		AABB bounds;
+		Vec3 centroid;
+		int index;
+	};
+	struct Bin
+	{
+		AABB bounds;
+		int count = 0;
+	};
+	static const int binCount = 16;
+	// Cost of one node visit relative to one primitive test
+	static constexpr double traversalCost = 0.125;
+
+	int maxLeafSize;
+
+	void Build(const std::vector<shared_ptr<RenderedObject>>& objects)
+	{
+		std::vector<BuildPrimitive> build;
+		build.reserve(objects.size());
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			AABB bounds = objects[i]->BoundingBox();
+			build.push_back(BuildPrimitive{ bounds, bounds.Centroid(), int(i) });
+		}
+		if (build.empty()) return;
+
+		nodes.reserve(2 * build.size());
+		primitives.reserve(build.size());
+		BuildRecursive(objects, build, 0, int(build.size()), 0);
+	}
+	int BuildRecursive(const std::vector<shared_ptr<RenderedObject>>& objects, std::vector<BuildPrimitive>& build, int start, int end, int depth)
+	{
+		int nodeIndex = int(nodes.size());
+		nodes.push_back(Node());
+
+		AABB bounds;
+		AABB centroidBounds;
+		for (int i = start; i < end; i++)
+		{
+			bounds.Expand(build[i].bounds);
+			centroidBounds.Expand(build[i].centroid);
+		}
+		nodes[nodeIndex].bounds = bounds;
+
+		int count = end - start;
+		int axis = centroidBounds.LongestAxis();
+		double axisMin = centroidBounds.min[axis];
+		double axisExtent = centroidBounds.max[axis] - axisMin;
+
+		// All centroids coincide, no split can separate them, or the traversal stacks are full
+		if (count == 1 || axisExtent <= 0 || depth >= maxDepth)
+		{
+			MakeLeaf(objects, build, nodeIndex, start, end);
+			return nodeIndex;
+		}
+
+		Bin bins[binCount];
+		auto binOf = [&](const BuildPrimitive& p)
+		{
+			int b = int(binCount * (p.centroid[axis] - axisMin) / axisExtent);
+			return std::min(b, binCount - 1);
+		};
+		for (int i = start; i < end; i++)
+		{
+			Bin& bin = bins[binOf(build[i])];
+			bin.count++;
+			bin.bounds.Expand(build[i].bounds);
+		}
+
+		// Sweep from the right to get the cost of every split plane in linear time
+		double rightArea[binCount - 1];
+		int rightCount[binCount - 1];
+		AABB rightBounds;
+		int countAbove = 0;
+		for (int i = binCount - 1; i > 0; i--)
+		{
+			rightBounds.Expand(bins[i].bounds);
+			countAbove += bins[i].count;
+			rightArea[i - 1] = rightBounds.SurfaceArea();
+			rightCount[i - 1] = countAbove;
+		}
+
+		int bestSplit = -1;
+		double bestCost = infinity;
+		AABB leftBounds;
+		int countBelow = 0;
+		for (int i = 0; i < binCount - 1; i++)
+		{
+			leftBounds.Expand(bins[i].bounds);
+			countBelow += bins[i].count;
+			double cost = countBelow * leftBounds.SurfaceArea() + rightCount[i] * rightArea[i];
+			if (countBelow > 0 && rightCount[i] > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+		bestCost = traversalCost + bestCost / bounds.SurfaceArea();
+
+		if (bestSplit < 0 || (count <= maxLeafSize && bestCost >= count))
+		{
+			MakeLeaf(objects, build, nodeIndex, start, end);
+			return nodeIndex;
+		}
+
+		auto mid = std::partition(build.begin() + start, build.begin() + end,
+			[&](const BuildPrimitive& p) { return binOf(p) <= bestSplit; });
+		int midIndex = int(mid - build.begin());
+
+		BuildRecursive(objects, build, start, midIndex, depth + 1);
+		int secondChild = BuildRecursive(objects, build, midIndex, end, depth + 1);
+
+		nodes[nodeIndex].offset = secondChild;
+		nodes[nodeIndex].primitiveCount = 0;
+		nodes[nodeIndex].axis = axis;
+		return nodeIndex;
+	}
+	void MakeLeaf(const std::vector<shared_ptr<RenderedObject>>& objects, const std::vector<BuildPrimitive>& build, int nodeIndex, int start, int end)
+	{
+		nodes[nodeIndex].offset = int(primitives.size());
+		nodes[nodeIndex].primitiveCount = end - start;
+		nodes[nodeIndex].axis = 0;
+		for (int i = start; i < end; i++) primitives.push_back(objects[build[i].index]);
+	}
+};
+
+#endif
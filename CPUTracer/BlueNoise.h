@@ -0,0 +1,114 @@
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Side of the tileable blue noise mask, a power of two
+const int blueNoiseSize = 64;
+
+/// <summary>
+/// Ranks 0 .. size*size-1 of a tileable blue noise dither mask, made with Ulichney's void and
+/// cluster method: a Gaussian energy on the torus finds the tightest cluster of set pixels and
+/// the largest void between them. size must be a power of two.
+/// </summary>
+inline std::vector<uint16_t> BuildBlueNoiseMask(int size, double sigma)
+{
+	const int n = size * size;
+	const int wrap = size - 1;
+
+	// Filter weight for every wrapped offset
+	std::vector<double> kernel(n);
+	for (int dy = 0; dy < size; dy++)
+	{
+		for (int dx = 0; dx < size; dx++)
+		{
+			int x = std::min(dx, size - dx);
+			int y = std::min(dy, size - dy);
+			kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2 * sigma * sigma));
+		}
+	}
+
+	std::vector<uint8_t> pattern(n, 0);
+	std::vector<double> energy(n, 0);
+	auto toggle = [&](int p)
+	{
+		double sign = pattern[p] ? -1 : 1;
+		pattern[p] ^= 1;
+		int px = p % size, py = p / size;
+		for (int y = 0; y < size; y++)
+		{
+			const double* row = &kernel[((y - py) & wrap) * size];
+			for (int x = 0; x < size; x++) energy[y * size + x] += sign * row[(x - px) & wrap];
+		}
+	};
+	auto tightestCluster = [&]()
+	{
+		int best = -1;
+		for (int p = 0; p < n; p++)
+			if (pattern[p] && (best < 0 || energy[p] > energy[best])) best = p;
+		return best;
+	};
+	auto largestVoid = [&]()
+	{
+		int best = -1;
+		for (int p = 0; p < n; p++)
+			if (!pattern[p] && (best < 0 || energy[p] < energy[best])) best = p;
+		return best;
+	};
+
+	// Random starting points, then move points from clusters into voids until nothing moves
+	const int ones = n / 10;
+	std::minstd_rand rng(1234);	// Fully specified by the standard, so every build gets the same mask
+	for (int placed = 0; placed < ones; )
+	{
+		int p = int(rng() % uint32_t(n));
+		if (pattern[p]) continue;
+		toggle(p);
+		placed++;
+	}
+	while (true)
+	{
+		int cluster = tightestCluster();
+		toggle(cluster);
+		int gap = largestVoid();
+		toggle(gap);
+		if (gap == cluster) break;
+	}
+
+	std::vector<uint16_t> rank(n);
+	std::vector<uint8_t> prototype = pattern;
+	std::vector<double> prototypeEnergy = energy;
+
+	// Lower ranks: take the prototype apart, tightest cluster first
+	for (int r = ones - 1; r >= 0; r--)
+	{
+		int cluster = tightestCluster();
+		toggle(cluster);
+		rank[cluster] = uint16_t(r);
+	}
+
+	// Higher ranks: fill the largest void. Past half full this is also the tightest cluster of
+	// the unset pixels, since the energies of set and unset pixels add up to a constant.
+	pattern = prototype;
+	energy = prototypeEnergy;
+	for (int r = ones; r < n; r++)
+	{
+		int gap = largestVoid();
+		toggle(gap);
+		rank[gap] = uint16_t(r);
+	}
+	return rank;
+}
+
+// The shared mask, built on first use
+inline const std::vector<uint16_t>& BlueNoiseMask()
+{
+	static const std::vector<uint16_t> mask = BuildBlueNoiseMask(blueNoiseSize, 1.5);
+	return mask;
+}
+
+#endif
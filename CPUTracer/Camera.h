@@ -4,11 +4,64 @@
 #include "Utils.h"
 #include "RenderedObject.h"
 #include "Material.h"
+#include "PathTracer.h"
+#include "Wavefront.h"
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+#include "Denoiser.h"
+#include "Aov.h"
+#include "HdrImage.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include "CostMap.h"
 
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
-#include <future>
+#include "EncodeQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class Integrator
+{
+	Path,		// TracePath, one path at a time
+	Wavefront	// WavefrontIntegrator, a queue of paths advanced one bounce at a time
+};
+
+/// <summary>
+/// Welford running mean and variance of a pixel's sample luminance, next to the plain colour sum
+/// the pixel is written from.
+/// </summary>
+struct PixelEstimate
+{
+	Vec3 sum;
+	int count = 0;
+	double mean = 0;
+	double m2 = 0;
+
+	void Add(const Vec3& color)
+	{
+		sum += color;
+		double luminance = 0.2126 * color.X() + 0.7152 * color.Y() + 0.0722 * color.Z();
+		count++;
+		double delta = luminance - mean;
+		mean += delta / count;
+		m2 += delta * (luminance - mean);
+	}
+	// Standard error of the mean over the pixel's brightness. Pixels darker than 0.1 are measured
+	// against 0.1 so black pixels don't ask for endless samples.
+	double RelativeError() const
+	{
+		if (count < 2) return infinity;
+		return std::sqrt(m2 / (count - 1) / count) / std::fmax(mean, 0.1);
+	}
+};
 
 class Camera
 {
@@ -21,57 +74,563 @@ public:
 	double aspectRatio = 0.0;
 	int samplesPerPixel = 10;
 	int maxRays = 4;
+	// Bounces every path gets before Russian roulette may end it, maxRays or more turns roulette off
+	int rouletteDepth = 3;
+	// Every random number is a function of this seed and the pixel, sample, bounce and dimension,
+	// so the same seed gives the same image with any thread count
+	uint32_t seed = 0;
+	// How those numbers are spread over the samples of a pixel, see SamplerType
+	SamplerType samplerType = SamplerType::Sobol;
+	// Where Render() saves the image, empty to skip writing it. The extension picks PNG, QOI or PPM
+	std::string outputPath = "output.png";
+	// Render() hands the image to background threads and returns as soon as the pixels are done;
+	// WaitForOutput() blocks until the file is written. Off writes it before Render() returns
+	bool asyncOutput = true;
+	// Threads that encode the images, 0 uses every hardware thread
+	int outputThreads = 0;
+	// Side of the square primary ray packets (2, 4 or 8), 0 traces every ray on its own
+	int packetSize = 0;
+	// Wavefront ignores packetSize
+	Integrator integrator = Integrator::Path;
+
+	// Where the camera is and how it is turned, as Euler degrees like Scene::cameraRot. Both are
+	// read at the start of every render, so a sequence can move one camera between frames
+	Vec3 cameraCenter = Vec3(0, 0, 0);
+	Vec3 cameraRotation = Vec3(0, 0, 0);
+
+	// Render workers, 0 uses every hardware thread
+	int threadCount = 0;
+	// Bind each worker to one CPU, in NUMA node order on Linux
+	bool pinThreads = false;
+	// Side of the square tiles the image is split into for the workers
+	int tileSize = 32;
+	// Adaptive sampling gives each tile batches of samplesPerPixel samples until the mean
+	// PixelEstimate::RelativeError of its pixels is under noiseThreshold or they have
+	// maxSamplesPerPixel samples. Always traces with the path loop, packetSize and integrator are ignored.
+	bool adaptiveSampling = false;
+	double noiseThreshold = 0.05;
+	int maxSamplesPerPixel = 256;
+	// Samples each pixel got in the last Render()
+	std::vector<int> sampleCounts;
 
-	uint8_t* Render(RenderedObject& scene)
+	// Diagnostic mode: measure what every pixel costs into pixelCycles and pixelTests, and have
+	// Render() save them as heatmaps next to outputPath, see WriteCostMaps()
+	bool costMaps = false;
+	// CycleCount() ticks and intersection tests per pixel of the last Render() with costMaps. Tests
+	// are ray/sphere tests in builds with SPEEDTRACER_COUNTERS and scene intersection queries
+	// otherwise. Packets and the wavefront integrator trace pixels together, so their cost is
+	// shared out evenly over each packet's block or each tile.
+	std::vector<float> pixelCycles;
+	std::vector<float> pixelTests;
+	// Values at the top of the colour scale in the last heatmaps written
+	float cycleScale = 0;
+	float testScale = 0;
+
+	// Fill aovs during Render(), denoise turns this on by itself
+	bool renderAovs = false;
+	AovBuffers aovs;
+	// Filter the finished image with denoiser, which follows the edges in aovs
+	bool denoise = false;
+	Denoiser denoiser;
+	// Where Render() saves the float image, see WriteHdr(). Empty to skip writing it
+	std::string hdrOutputPath;
+
+	// Tiles that workers stole from each other during the last Render(), shows how uneven the load was
+	int tilesStolen = 0;
+	// Samples and rays of the last Render()
+	RenderStats stats;
+	// Linear RGB of the last Render() before the 8 bit conversion, 3 floats per pixel
+	std::vector<float> radiance;
+
+	// scene is the geometry to trace (a Scene or an acceleration structure built from one), materials the table its ids index
+	uint8_t* Render(RenderedObject& scene, const MaterialTable& materials)
 	{
+		TraceScope trace("render", "render", "width", imageWidth, "height", imageHeight);
 		Init();
 
 		uint8_t* imageData;
 		imageData = (uint8_t*)malloc(imageWidth * imageHeight * 3 * sizeof(uint8_t));
+		radiance.assign(size_t(imageWidth) * imageHeight * 3, 0.0f);
+		sampleCounts.assign(size_t(imageWidth) * imageHeight, adaptiveSampling ? 0 : samplesPerPixel);
+		pixelCycles.assign(costMaps ? size_t(imageWidth) * imageHeight : 0, 0.0f);
+		pixelTests.assign(pixelCycles.size(), 0.0f);
+		fillAovs = renderAovs || denoise;
+		if (fillAovs) aovs.Resize(size_t(imageWidth) * imageHeight);
 
-		std::cout << std::thread::hardware_concurrency();
+		ThreadPool& workers = Pool();
+		TileScheduler scheduler(imageWidth, imageHeight, std::max(1, tileSize), workers.WorkerCount());
+		AlignedVector<WorkerStats> workerStats(workers.WorkerCount());
+		auto start = std::chrono::high_resolution_clock::now();
+		workers.Run([&](int worker) { RenderWorker(scheduler, worker, imageData, scene, materials, workerStats[worker]); });
+		stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		tilesStolen = scheduler.StealCount();
+		MergeStats(workerStats, stats);
 
-		const int total = imageHeight;
-		const int threads = 8;
-		int chunk = total / threads;
+		if (denoise)
+		{
+			TraceScope trace("denoise", "render");
+			denoiser.Run(workers, imageWidth, imageHeight, radiance, aovs);
+			for (int j = 0; j < imageHeight; j++)
+			{
+				for (int i = 0; i < imageWidth; i++)
+				{
+					const float* c = &radiance[(size_t(j) * imageWidth + i) * 3];
+					WriteColor(imageData, Vec3(c[0], c[1], c[2]), i, j, imageWidth);
+				}
+			}
+		}
 
-		std::vector<std::future<void>> futures;
+		if (!outputPath.empty()) SaveImage(outputPath, imageData);
+		if (costMaps && !outputPath.empty()) WriteCostMaps(outputPath);
+		if (!hdrOutputPath.empty())
+		{
+			TraceScope trace("write hdr", "encode");
+			WriteHdr(hdrOutputPath);
+		}
+		return imageData;
+	}
+	/// <summary>
+	/// Saves an 8 bit RGB image the size of this camera's, in the format of path's extension. With
+	/// asyncOutput a copy goes to the output threads and this returns at once.
+	/// </summary>
+	bool SaveImage(const std::string& path, const uint8_t* imageData)
+	{
+		if (!asyncOutput) return WriteImage(path, imageWidth, imageHeight, imageData);
+		size_t size = size_t(imageWidth) * imageHeight * 3;
+		uint8_t* copy = (uint8_t*)malloc(size);
+		memcpy(copy, imageData, size);
+		Output().Push(path, imageWidth, imageHeight, copy);
+		return true;
+	}
+	// Blocks until every image Render() or SaveImage() queued is written. False if any failed
+	bool WaitForOutput() { return output ? output->Wait() : true; }
+	/// <summary>
+	/// The output threads, made on first use and again when outputThreads changes. Images still
+	/// queued on the old threads are written before they stop.
+	/// </summary>
+	EncodeQueue& Output()
+	{
+		int threads = outputThreads > 0 ? outputThreads : std::max(1, int(std::thread::hardware_concurrency()));
+		if (!output || output->ThreadCount() != threads)
+		{
+			output.reset();
+			output.reset(new EncodeQueue(threads));
+		}
+		return *output;
+	}
+	/// <summary>
+	/// Saves the last Render() as floats, with no 8 bit step. A path ending in .pfm gets the colour
+	/// alone, any other path a multi layer EXR with the colour as R, G, B and, when aovs were
+	/// filled, normal.XYZ, albedo.RGB, Z (depth), materialId and rays.
+	/// </summary>
+	bool WriteHdr(const std::string& path) const
+	{
+		if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0)
+			return WritePfm(path, imageWidth, imageHeight, 3, radiance.data());
 
-		for (int t = 0; t < threads; ++t) {
-			int start = t * chunk;
-			int end = (t == threads - 1) ? total : start + chunk;
+		std::vector<ExrLayer> layers = { { "", { "R", "G", "B" }, radiance.data() } };
+		if (fillAovs)
+		{
+			layers.push_back({ "normal", { "X", "Y", "Z" }, aovs.normal.data() });
+			layers.push_back({ "albedo", { "R", "G", "B" }, aovs.albedo.data() });
+			layers.push_back({ "", { "Z" }, aovs.depth.data() });
+			layers.push_back({ "", { "materialId" }, aovs.materialId.data() });
+			layers.push_back({ "", { "rays" }, aovs.rays.data() });
+		}
+		return WriteExr(path, imageWidth, imageHeight, layers);
+	}
+	/// <summary>
+	/// Adds sample sampleIndex of every pixel to accum, 4 floats per pixel: the RGB sum and the
+	/// sample count. Each tile is added under accumLock when it finishes, so accum can be read
+	/// under the same lock while the pass runs. Once cancel is set no new tiles are started; the
+	/// finished ones keep their sample. Always traces with the path loop.
+	/// </summary>
+	void RenderPass(RenderedObject& scene, const MaterialTable& materials, float* accum, std::mutex& accumLock, uint32_t sampleIndex, const std::atomic<bool>& cancel)
+	{
+		Init();
+		ThreadPool& workers = Pool();
+		TileScheduler scheduler(imageWidth, imageHeight, std::max(1, tileSize), workers.WorkerCount());
+		PathTracerFunction tracePath = PathTracerFor(maxRays);
 
-			futures.push_back(std::async(std::launch::async, &Camera::RenderRange, this, imageData, start, end, std::ref(scene)));
+		workers.Run([&](int worker)
+		{
+			Sampler sampler(seed, samplerType);
+			std::vector<Vec3> colors;
+			Tile tile;
+			while (!cancel.load(std::memory_order_relaxed) && scheduler.Next(worker, tile))
+			{
+				colors.resize(tile.Width() * tile.Height());
+				Vec3* color = colors.data();
+				for (int j = tile.y0; j < tile.y1; j++)
+				{
+					for (int i = tile.x0; i < tile.x1; i++)
+					{
+						sampler.StartSample(i, j, sampleIndex);
+						Ray r = GetRay(i, j, sampler);
+						int rays = 0;
+						*color++ = tracePath(r, nullptr, scene, materials, maxRays, rouletteDepth, sampler, rays);
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(accumLock);
+				color = colors.data();
+				for (int j = tile.y0; j < tile.y1; j++)
+				{
+					float* out = accum + (size_t(j) * imageWidth + tile.x0) * 4;
+					for (int i = tile.x0; i < tile.x1; i++, color++, out += 4)
+					{
+						out[0] += float(color->X());
+						out[1] += float(color->Y());
+						out[2] += float(color->Z());
+						out[3] += 1.0f;
+					}
+				}
+			}
+		});
+	}
+	/// <summary>
+	/// The render threads, kept alive between Render() calls. Recreated when threadCount or
+	/// pinThreads change.
+	/// </summary>
+	ThreadPool& Pool()
+	{
+		int workers = threadCount > 0 ? threadCount : std::max(1, int(std::thread::hardware_concurrency()));
+		if (!pool || pool->WorkerCount() != workers || poolPinned != pinThreads)
+		{
+			pool.reset();
+			pool.reset(new ThreadPool(workers, pinThreads));
+			poolPinned = pinThreads;
 		}
+		return *pool;
+	}
+	ThreadPool::Stats PoolStats() const { return pool ? pool->GetStats() : ThreadPool::Stats(); }
 
-		for (auto& f : futures) f.get();
+	/// <summary>
+	/// Saves pixelCycles and pixelTests as false colour heatmaps named after path (output.png gives
+	/// output_cycles.png and output_tests.png), see Heatmap(). Their scales end up in cycleScale
+	/// and testScale. Returns false if costMaps was off for the last Render() or a file failed.
+	/// </summary>
+	bool WriteCostMaps(const std::string& path)
+	{
+		if (pixelCycles.empty()) return false;
+		uint8_t* cycles = Heatmap(pixelCycles, cycleScale);
+		bool ok = SaveImage(SiblingPath(path, "_cycles"), cycles);
+		free(cycles);
+		uint8_t* tests = Heatmap(pixelTests, testScale);
+		ok = SaveImage(SiblingPath(path, "_tests"), tests) && ok;
+		free(tests);
+		return ok;
+	}
 
-		stbi_write_png("output.png", imageWidth, imageHeight, 3, imageData, imageWidth * 3);
-		return imageData;
+	// Saves sampleCounts as a grey PNG, white at maxSamplesPerPixel (or the largest count when it is bigger)
+	bool WriteSampleMap(const std::string& path) const
+	{
+		int brightest = adaptiveSampling ? maxSamplesPerPixel : 1;
+		for (int count : sampleCounts) brightest = std::max(brightest, count);
+
+		std::vector<uint8_t> map(sampleCounts.size());
+		for (size_t i = 0; i < map.size(); i++) map[i] = uint8_t(255.0 * sampleCounts[i] / brightest + 0.5);
+		return stbi_write_png(path.c_str(), imageWidth, imageHeight, 1, map.data(), imageWidth) != 0;
 	}
-	void RenderRange(uint8_t* imageData, int startHeight, int endHeight, RenderedObject& scene)
+
+	// Counts into a local WorkerStats and copies it to out at the end, so workers never write next to each other
+	void RenderWorker(TileScheduler& scheduler, int worker, uint8_t* imageData, RenderedObject& scene, const MaterialTable& materials, WorkerStats& out)
 	{
-		for (int j = startHeight; j < endHeight; j++)
+		Sampler sampler(seed, samplerType);
+		WorkerStats counts;
+		counts.Reset(maxRays);
+#if SPEEDTRACER_COUNTERS
+		ThreadCounters() = &counts.counters;
+#endif
+		auto start = std::chrono::high_resolution_clock::now();
+		Tile tile;
+		while (scheduler.Next(worker, tile))
+		{
+			TraceScope trace("tile", "render", "x", tile.x0, "y", tile.y0);
+			RenderRange(imageData, tile, scene, materials, sampler, counts);
+		}
+		counts.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+#if SPEEDTRACER_COUNTERS
+		ThreadCounters() = nullptr;
+#endif
+		out = counts;
+	}
+	void RenderRange(uint8_t* imageData, const Tile& tile, RenderedObject& scene, const MaterialTable& materials, Sampler& sampler, WorkerStats& counts)
+	{
+		if (fillAovs) RenderAovs(tile, scene, materials);
+		if (adaptiveSampling)
+		{
+			RenderRangeAdaptive(imageData, tile, scene, materials, sampler, counts);
+			return;
+		}
+		if (integrator == Integrator::Wavefront)
 		{
-			//std::clog << "\rScanlines remaining: " << (imageHeight - j) << ' ' << std::flush;
-			for (int i = 0; i < imageWidth; i++)
+			RenderRangeWavefront(imageData, tile, scene, materials, sampler, counts);
+			return;
+		}
+		if (packetSize > 0)
+		{
+			RenderRangePackets(imageData, tile, scene, materials, sampler, counts);
+			return;
+		}
+		PathTracerFunction tracePath = PathTracerFor(maxRays);
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
 			{
 				Vec3 color(0, 0, 0);
+				int rays = 0;
+				uint64_t startCycles = costMaps ? CycleCount() : 0;
+				long long startTests = TestCount(0);
 				for (int s = 0; s < samplesPerPixel; s++)
 				{
-					Ray r = GetRay(i, j);
-					color += RayColor(r, maxRays, scene);
+					sampler.StartSample(i, j, uint32_t(s));
+					Ray r = GetRay(i, j, sampler);
+					int before = rays;
+					color += tracePath(r, nullptr, scene, materials, maxRays, rouletteDepth, sampler, rays);
+					counts.CountPath(rays - before);
+				}
+				if (costMaps) AddCost(i, j, i + 1, j + 1, CycleCount() - startCycles, TestCount(rays) - startTests);
+				WritePixel(imageData, pixelSampleScale * color, i, j);
+				WriteRays(i, j, rays, samplesPerPixel);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Traces the primary rays of packetSize x packetSize pixel blocks together, one sample of
+	/// each pixel per packet. Bounces after the first hit are traced ray by ray.
+	/// </summary>
+	void RenderRangePackets(uint8_t* imageData, const Tile& tile, const RenderedObject& scene, const MaterialTable& materials, Sampler& sampler, WorkerStats& counts)
+	{
+		const int size = std::max(1, std::min(packetSize, 8));
+		PathTracerFunction tracePath = PathTracerFor(maxRays);
+		RayPacket packet;
+		HitInfo hits[RayPacket::maxSize];
+		Vec3 colors[RayPacket::maxSize];
+		int rays[RayPacket::maxSize];
+
+		for (int j0 = tile.y0; j0 < tile.y1; j0 += size)
+		{
+			int j1 = std::min(j0 + size, tile.y1);
+			for (int i0 = tile.x0; i0 < tile.x1; i0 += size)
+			{
+				int i1 = std::min(i0 + size, tile.x1);
+				int count = (j1 - j0) * (i1 - i0);
+				for (int k = 0; k < count; k++)
+				{
+					colors[k] = Vec3(0, 0, 0);
+					rays[k] = 0;
+				}
+				uint64_t startCycles = costMaps ? CycleCount() : 0;
+				long long startTests = TestCount(0);
+
+				for (int s = 0; s < samplesPerPixel && maxRays > 0; s++)
+				{
+					packet.Clear();
+					for (int j = j0; j < j1; j++)
+					{
+						for (int i = i0; i < i1; i++)
+						{
+							sampler.StartSample(i, j, uint32_t(s));
+							packet.Add(GetRay(i, j, sampler));
+						}
+					}
+					packet.Finalize(Interval(0.003, infinity));
+
+					uint64_t hitMask = scene.CheckHitPacket(packet, hits);
+					SPEEDTRACER_COUNT(primaryRays, count);
+					for (int k = 0; k < count; k++)
+					{
+						int before = rays[k]++;
+						if ((hitMask >> k) & 1)
+						{
+							SPEEDTRACER_COUNT(hits, 1);
+							sampler.StartSample(i0 + k % (i1 - i0), j0 + k / (i1 - i0), uint32_t(s));
+							colors[k] += tracePath(packet.rays[k], &hits[k], scene, materials, maxRays, rouletteDepth, sampler, rays[k]);
+						}
+						else
+						{
+							SPEEDTRACER_COUNT(escaped, 1);
+							colors[k] += Background(packet.rays[k]);
+						}
+						counts.CountPath(rays[k] - before);
+					}
+				}
+
+				if (costMaps)
+				{
+					int blockRays = 0;
+					for (int b = 0; b < count; b++) blockRays += rays[b];
+					AddCost(i0, j0, i1, j1, CycleCount() - startCycles, TestCount(blockRays) - startTests);
+				}
+
+				int k = 0;
+				for (int j = j0; j < j1; j++)
+				{
+					for (int i = i0; i < i1; i++, k++)
+					{
+						WritePixel(imageData, pixelSampleScale * colors[k], i, j);
+						WriteRays(i, j, rays[k], samplesPerPixel);
+					}
+				}
+			}
+		}
+	}
+
+	// Traces the unjittered centre ray of each pixel for the first hit layers of aovs
+	void RenderAovs(const Tile& tile, const RenderedObject& scene, const MaterialTable& materials)
+	{
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
+			{
+				size_t p = size_t(j) * imageWidth + i;
+				Vec3 pixelCenter = pixel00LOC + i * pixelDeltaU + j * pixelDeltaV;
+				Ray r(cameraCenter, pixelCenter - cameraCenter);
+				HitInfo hit;
+				if (!scene.CheckHit(r, Interval(0.003, infinity), hit)) continue;
+
+				Vec3 albedo = GuideAlbedo(materials.Record(hit.materialId));
+				for (int c = 0; c < 3; c++)
+				{
+					aovs.normal[p * 3 + c] = float(hit.normal[c]);
+					aovs.albedo[p * 3 + c] = float(albedo[c]);
 				}
-				WriteColor(imageData, pixelSampleScale * color, i, j, imageWidth);
+				aovs.depth[p] = float(hit.t * r.Direction().Length());
+				aovs.materialId[p] = float(hit.materialId);
+			}
+		}
+	}
+
+	void RenderRangeAdaptive(uint8_t* imageData, const Tile& tile, const RenderedObject& scene, const MaterialTable& materials, Sampler& sampler, WorkerStats& counts)
+	{
+		const int width = tile.Width();
+		const int batch = std::max(1, samplesPerPixel);
+		const int budget = std::max(batch, maxSamplesPerPixel);
+		PathTracerFunction tracePath = PathTracerFor(maxRays);
+		std::vector<PixelEstimate> estimates(width * tile.Height());
+		std::vector<int> rays(estimates.size(), 0);
+
+		int taken = 0;
+		while (taken < budget)
+		{
+			int end = std::min(taken + batch, budget);
+			for (int j = tile.y0; j < tile.y1; j++)
+			{
+				for (int i = tile.x0; i < tile.x1; i++)
+				{
+					int k = (j - tile.y0) * width + i - tile.x0;
+					uint64_t startCycles = costMaps ? CycleCount() : 0;
+					long long startTests = TestCount(rays[k]);
+					for (int s = taken; s < end; s++)
+					{
+						sampler.StartSample(i, j, uint32_t(s));
+						Ray r = GetRay(i, j, sampler);
+						int before = rays[k];
+						estimates[k].Add(tracePath(r, nullptr, scene, materials, maxRays, rouletteDepth, sampler, rays[k]));
+						counts.CountPath(rays[k] - before);
+					}
+					if (costMaps) AddCost(i, j, i + 1, j + 1, CycleCount() - startCycles, TestCount(rays[k]) - startTests);
+				}
+			}
+			taken = end;
+
+			double error = 0;
+			for (const PixelEstimate& estimate : estimates) error += estimate.RelativeError();
+			if (error / estimates.size() <= noiseThreshold) break;
+		}
+
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
+			{
+				int k = (j - tile.y0) * width + i - tile.x0;
+				WritePixel(imageData, estimates[k].sum / taken, i, j);
+				WriteRays(i, j, rays[k], taken);
+				sampleCounts[size_t(j) * imageWidth + i] = taken;
+			}
+		}
+	}
+
+	void RenderRangeWavefront(uint8_t* imageData, const Tile& tile, const RenderedObject& scene, const MaterialTable& materials, Sampler& sampler, WorkerStats& counts)
+	{
+		const int width = tile.Width();
+		std::vector<Vec3> accum(width * tile.Height());
+		std::vector<float> rays(accum.size(), 0.0f);
+
+		uint64_t startCycles = costMaps ? CycleCount() : 0;
+		long long startTests = TestCount(0);
+		WavefrontIntegrator wavefront;
+		wavefront.Render(scene, materials, int(accum.size()), samplesPerPixel, maxRays, rouletteDepth,
+			[&](int pixel, int sampleIndex, Sampler& pathSampler)
+			{
+				int i = tile.x0 + pixel % width;
+				int j = tile.y0 + pixel / width;
+				pathSampler.StartSample(i, j, uint32_t(sampleIndex));
+				return GetRay(i, j, pathSampler);
+			},
+			Background, accum.data(), sampler, rays.data(), counts.bounceRays.data());
+		counts.samples += (long long)accum.size() * samplesPerPixel;
+		if (costMaps)
+		{
+			float tileRays = 0;
+			for (float r : rays) tileRays += r;
+			AddCost(tile.x0, tile.y0, tile.x1, tile.y1, CycleCount() - startCycles, TestCount(int(tileRays)) - startTests);
+		}
+
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
+			{
+				int k = (j - tile.y0) * width + i - tile.x0;
+				WritePixel(imageData, pixelSampleScale * accum[k], i, j);
+				WriteRays(i, j, int(rays[k]), samplesPerPixel);
 			}
 		}
 	}
 
 private:
+	std::unique_ptr<ThreadPool> pool;
+	bool poolPinned = false;
+	std::unique_ptr<EncodeQueue> output;
+	// renderAovs || denoise for the Render() in progress
+	bool fillAovs = false;
+
+	// Intersection tests this thread has made: its ray/sphere test counter when the counters are
+	// compiled in, otherwise rays, the scene queries the caller has counted itself
+	static long long TestCount(int rays)
+	{
+#if SPEEDTRACER_COUNTERS
+		RayCounters* counters = ThreadCounters();
+		return counters ? counters->primitiveTests : rays;
+#else
+		return rays;
+#endif
+	}
+	// Adds cost to pixelCycles and pixelTests, shared evenly over the pixels x0 <= i < x1, y0 <= j < y1
+	void AddCost(int x0, int y0, int x1, int y1, uint64_t cycles, long long tests)
+	{
+		float share = 1.0f / ((x1 - x0) * (y1 - y0));
+		for (int j = y0; j < y1; j++)
+		{
+			for (int i = x0; i < x1; i++)
+			{
+				size_t p = size_t(j) * imageWidth + i;
+				pixelCycles[p] += float(cycles) * share;
+				pixelTests[p] += float(tests) * share;
+			}
+		}
+	}
+
+	// Records the mean rays per sample of a pixel when aovs are being filled
+	void WriteRays(int i, int j, int rays, int samples)
+	{
+		if (fillAovs && samples > 0) aovs.rays[size_t(j) * imageWidth + i] = float(rays) / samples;
+	}
 
 	//Camera
 	double focalLength = 1.0;
-	Vec3 cameraCenter = Vec3(0, 0, 0);
 
 	Vec3 pixelDeltaU;
 	Vec3 pixelDeltaV;
@@ -86,43 +645,34 @@ private:
 		double viewportHeight = 2.0;
 		double viewPortWidth = viewportHeight * aspectRatio;
 
-		Vec3 viewportU = Vec3(viewPortWidth, 0, 0);
-		Vec3 viewportV = Vec3(0, -viewportHeight, 0);
+		Vec3 viewportU = RotateEuler(Vec3(viewPortWidth, 0, 0), cameraRotation);
+		Vec3 viewportV = RotateEuler(Vec3(0, -viewportHeight, 0), cameraRotation);
 		pixelDeltaU = viewportU / imageWidth;
 		pixelDeltaV = viewportV / imageHeight;
 
-		viewportTopLeft = cameraCenter + Vec3(0, 0, focalLength) - viewportU / 2 - viewportV / 2;
+		viewportTopLeft = cameraCenter + RotateEuler(Vec3(0, 0, focalLength), cameraRotation) - viewportU / 2 - viewportV / 2;
 		pixel00LOC = viewportTopLeft + 0.5 * (pixelDeltaU + pixelDeltaV);
 
 		pixelSampleScale = 1.0 / samplesPerPixel;
 	}
-	static Vec3 RayColor(const Ray& r, int detph, const RenderedObject& scene)
+	// Stores the finished pixel in both the 8 bit image and radiance
+	void WritePixel(uint8_t* imageData, const Vec3& color, int i, int j)
 	{
-		if (detph <= 0) return Vec3(0, 0, 0);
-		HitInfo hit;
-		if (scene.CheckHit(r, Interval(0.003, infinity), hit))
-		{
-			Ray scattered;
-			Vec3 attenuation;
-			if (hit.mat->Scatter(r, hit, attenuation, scattered))
-			{
-				return attenuation * RayColor(scattered, detph - 1, scene);
-			}
-			return Vec3(0, 0, 0);
-		}
-		Vec3 unitDirection = Normalize(r.Direction());
-		double a = 0.5 * (unitDirection.Y() + 1.0);
-		return (1.0 - a) * Vec3(1.0, 1.0, 1.0) + a * Vec3(0.5, 0.7, 1.0);
+		WriteColor(imageData, color, i, j, imageWidth);
+		float* out = &radiance[(size_t(j) * imageWidth + i) * 3];
+		out[0] = float(color.X());
+		out[1] = float(color.Y());
+		out[2] = float(color.Z());
 	}
-	Ray GetRay(int i, int j)
+	Ray GetRay(int i, int j, Sampler& sampler)
 	{
-		Vec3 offset = SampleSquare();
+		Vec3 offset = SampleSquare(sampler);
 		Vec3 pixelSample = pixel00LOC + (i + offset.X()) * pixelDeltaU + (j + offset.Y()) * pixelDeltaV;
 		return Ray(cameraCenter, pixelSample - cameraCenter);
 	}
-	Vec3 SampleSquare() const
+	Vec3 SampleSquare(Sampler& sampler) const
 	{
-		return Vec3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0);
+		return Vec3(sampler.Next() - 0.5, sampler.Next() - 0.5, 0);
 	}
 };
 
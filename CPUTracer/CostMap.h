@@ -0,0 +1,81 @@
+#ifndef COST_MAP_H
+#define COST_MAP_H
+
+#include "Vec3.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SPEEDTRACER_HAS_RDTSC 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define SPEEDTRACER_HAS_RDTSC 1
+#endif
+
+/// <summary>
+/// Time stamp counter ticks, cheap enough to read around every pixel. Ticks run at a fixed rate
+/// on current x86 CPUs, not at the core clock, and can't be compared across machines. Other CPUs
+/// fall back to steady clock nanoseconds.
+/// </summary>
+inline uint64_t CycleCount()
+{
+#ifdef SPEEDTRACER_HAS_RDTSC
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// The Turbo colour map, dark blue at 0 through green and yellow to dark red at 1
+inline Vec3 HeatColor(double t)
+{
+	t = std::fmin(std::fmax(t, 0.0), 1.0);
+	double r = 0.13572138 + t * (4.61539260 + t * (-42.66032258 + t * (132.13108234 + t * (-152.94239396 + t * 59.28637943))));
+	double g = 0.09140261 + t * (2.19418839 + t * (4.84296658 + t * (-14.18503333 + t * (4.27729857 + t * 2.82956604))));
+	double b = 0.10667330 + t * (12.64194608 + t * (-60.58204836 + t * (110.36276771 + t * (-89.90310912 + t * 27.34824973))));
+	return Vec3(std::fmin(std::fmax(r, 0.0), 1.0), std::fmin(std::fmax(g, 0.0), 1.0), std::fmin(std::fmax(b, 0.0), 1.0));
+}
+
+/// <summary>
+/// False colour 8 bit RGB image of values (one per pixel). The scale runs from 0 to the 99.5th
+/// percentile, so a few extreme pixels don't flatten the rest, and brighter pixels saturate at
+/// dark red. scale gets the value that maps to the top of the colour map. The result is malloc'd
+/// like Camera::Render()'s image.
+/// </summary>
+inline uint8_t* Heatmap(const std::vector<float>& values, float& scale)
+{
+	std::vector<float> sorted(values);
+	scale = 0;
+	if (!sorted.empty())
+	{
+		size_t top = std::min(sorted.size() - 1, size_t(sorted.size() * 0.995));
+		std::nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+		scale = sorted[top];
+	}
+
+	uint8_t* rgb = (uint8_t*)malloc(values.size() * 3);
+	for (size_t p = 0; p < values.size(); p++)
+	{
+		Vec3 color = HeatColor(scale > 0 ? values[p] / scale : 0.0);
+		for (int c = 0; c < 3; c++) rgb[p * 3 + c] = uint8_t(255.999 * color[c]);
+	}
+	return rgb;
+}
+
+// path with suffix before its extension: output.png, "_cycles" -> output_cycles.png
+inline std::string SiblingPath(const std::string& path, const std::string& suffix)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix + ".png";
+	return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "Simd.h"
+#include "ThreadPool.h"
+#include "Aov.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// e^x for x <= 0 from a degree 5 polynomial of 2^fraction, relative error below 1e-6
+inline float FastExp(float x)
+{
+	float t = std::max(x, -87.0f) * 1.44269504f;
+	float whole = std::floor(t);
+	float f = t - whole;
+	float p = 1.0f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * 0.00133335581f))));
+	int32_t bits = (int32_t(whole) + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+inline __m256 FastExp(__m256 x)
+{
+	__m256 t = _mm256_mul_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(1.44269504f));
+	__m256 whole = _mm256_floor_ps(t);
+	__m256 f = _mm256_sub_ps(t, whole);
+	__m256 p = _mm256_set1_ps(0.00133335581f);
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.00961812911f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.0555041087f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.240226507f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.693147182f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+	__m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+inline __m128 FastExp(__m128 x)
+{
+	__m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-87.0f)), _mm_set1_ps(1.44269504f));
+	// SSE2 has no floor: truncate, then step down where that rounded a negative value up
+	__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+	whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, t), _mm_set1_ps(1.0f)));
+	__m128 f = _mm_sub_ps(t, whole);
+	__m128 p = _mm_set1_ps(0.00133335581f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00961812911f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041087f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.240226507f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.693147182f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+	__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+}
+#endif
+
+/// <summary>
+/// Edge avoiding a-trous wavelet filter in the style of SVGF (Schied et al. 2017). The albedo is
+/// divided out first so texture detail isn't blurred, then a 5x5 B3 spline kernel is applied
+/// iterations times with its taps spread 1, 2, 4, ... pixels apart. Each tap is weighted down by
+/// normal, depth and luminance differences, the luminance one scaled by the estimated standard
+/// deviation so noisy pixels are smoothed harder. The variance starts as the 3x3 spatial variance
+/// and is filtered along with the colour.
+/// Rows are split between the pool's workers, the tap loop runs across simdWidth pixels at once.
+/// </summary>
+class Denoiser
+{
+public:
+	int iterations = 5;
+	float sigmaLuminance = 4.0f;
+	// The normal weight is max(0, dot)^(2^normalSquarings)
+	int normalSquarings = 7;
+	float sigmaDepth = 1.0f;
+
+	// color holds 3 floats per pixel and is filtered in place
+	void Run(ThreadPool& pool, int width, int height, std::vector<float>& color, const AovBuffers& guides)
+	{
+		this->width = width;
+		this->height = height;
+		const size_t pixels = size_t(width) * height;
+		for (Planes* planes : { &ping, &pong })
+		{
+			planes->r.assign(pixels, 0.0f);
+			planes->g.assign(pixels, 0.0f);
+			planes->b.assign(pixels, 0.0f);
+			planes->variance.assign(pixels, 0.0f);
+		}
+		nx.resize(pixels);
+		ny.resize(pixels);
+		nz.resize(pixels);
+		depth.resize(pixels);
+		depthScale.resize(pixels);
+		luminanceScale.resize(pixels);
+
+		const int workers = pool.WorkerCount();
+		pool.Run([&](int worker)
+		{
+			for (int y = worker; y < height; y += workers) Demodulate(y, color, guides);
+		});
+		pool.Run([&](int worker)
+		{
+			for (int y = worker; y < height; y += workers) PrepareRow(y);
+		});
+
+		Planes* in = &ping;
+		Planes* out = &pong;
+		for (int i = 0; i < iterations; i++)
+		{
+			const int step = 1 << i;
+			pool.Run([&](int worker)
+			{
+				for (int y = worker; y < height; y += workers) LuminanceScaleRow(y, *in);
+			});
+			pool.Run([&](int worker)
+			{
+				AlignedVector<float> scratch(size_t(width) * 5);
+				for (int y = worker; y < height; y += workers) FilterRow(y, step, *in, *out, scratch.data());
+			});
+			std::swap(in, out);
+		}
+
+		pool.Run([&](int worker)
+		{
+			for (int y = worker; y < height; y += workers) Remodulate(y, *in, color, guides);
+		});
+	}
+
+private:
+	struct Planes
+	{
+		AlignedVector<float> r, g, b, variance;
+	};
+	Planes ping, pong;
+	AlignedVector<float> nx, ny, nz, depth;
+	AlignedVector<float> depthScale;		// 1 / (sigmaDepth * depth gradient), per pixel
+	AlignedVector<float> luminanceScale;	// 1 / (sigmaLuminance * standard deviation), per pixel and iteration
+	int width = 0, height = 0;
+
+	static float Luminance(float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+	void Demodulate(int y, const std::vector<float>& color, const AovBuffers& guides)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			size_t p = size_t(y) * width + x;
+			const float* c = &color[p * 3];
+			const float* a = &guides.albedo[p * 3];
+			ping.r[p] = a[0] > 1e-3f ? c[0] / a[0] : c[0];
+			ping.g[p] = a[1] > 1e-3f ? c[1] / a[1] : c[1];
+			ping.b[p] = a[2] > 1e-3f ? c[2] / a[2] : c[2];
+			nx[p] = guides.normal[p * 3];
+			ny[p] = guides.normal[p * 3 + 1];
+			nz[p] = guides.normal[p * 3 + 2];
+			depth[p] = guides.depth[p];
+		}
+	}
+	void Remodulate(int y, const Planes& planes, std::vector<float>& color, const AovBuffers& guides) const
+	{
+		for (int x = 0; x < width; x++)
+		{
+			size_t p = size_t(y) * width + x;
+			float* c = &color[p * 3];
+			const float* a = &guides.albedo[p * 3];
+			c[0] = a[0] > 1e-3f ? planes.r[p] * a[0] : planes.r[p];
+			c[1] = a[1] > 1e-3f ? planes.g[p] * a[1] : planes.g[p];
+			c[2] = a[2] > 1e-3f ? planes.b[p] * a[2] : planes.b[p];
+		}
+	}
+
+	// Starting variance and the depth gradient, both from the 3x3 neighbourhood
+	void PrepareRow(int y)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			size_t p = size_t(y) * width + x;
+			float sum = 0, sumSquares = 0;
+			int count = 0;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int qx = x + dx, qy = y + dy;
+					if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+					size_t q = size_t(qy) * width + qx;
+					float l = Luminance(ping.r[q], ping.g[q], ping.b[q]);
+					sum += l;
+					sumSquares += l * l;
+					count++;
+				}
+			}
+			float mean = sum / count;
+			ping.variance[p] = std::max(0.0f, sumSquares / count - mean * mean);
+
+			// The smaller of the one sided differences, so a silhouette doesn't make its own edge look flat
+			auto slope = [&](int dx, int dy)
+			{
+				float best = aovMissDepth;
+				for (int side = -1; side <= 1; side += 2)
+				{
+					int qx = x + side * dx, qy = y + side * dy;
+					if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+					best = std::min(best, std::fabs(depth[size_t(qy) * width + qx] - depth[p]));
+				}
+				return best;
+			};
+			float gradient = std::max(slope(1, 0), slope(0, 1));
+			depthScale[p] = 1.0f / (sigmaDepth * gradient + 1e-4f);
+		}
+	}
+	void LuminanceScaleRow(int y, const Planes& planes)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			size_t p = size_t(y) * width + x;
+			luminanceScale[p] = 1.0f / (sigmaLuminance * std::sqrt(planes.variance[p]) + 1e-4f);
+		}
+	}
+
+	void FilterRow(int y, int step, const Planes& in, Planes& out, float* scratch) const
+	{
+		static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+		float* sumR = scratch;
+		float* sumG = scratch + width;
+		float* sumB = scratch + 2 * width;
+		float* sumW = scratch + 3 * width;
+		float* sumV = scratch + 4 * width;
+		std::fill(scratch, scratch + size_t(width) * 5, 0.0f);
+
+		for (int ty = -2; ty <= 2; ty++)
+		{
+			int qy = y + ty * step;
+			if (qy < 0 || qy >= height) continue;
+			for (int tx = -2; tx <= 2; tx++)
+			{
+				int offset = tx * step;
+				int x0 = std::max(0, -offset);
+				int x1 = std::min(width, width - offset);
+				float h = kernel[ty + 2] * kernel[tx + 2];
+				// Depth may change this much more per unit of gradient the further the tap is
+				float invDistance = (tx || ty) ? 1.0f / (step * std::sqrt(float(tx * tx + ty * ty))) : 0.0f;
+				Tap(y, qy, offset, x0, x1, h, invDistance, in, sumR, sumG, sumB, sumW, sumV);
+			}
+		}
+
+		for (int x = 0; x < width; x++)
+		{
+			size_t p = size_t(y) * width + x;
+			// The centre tap always counts, guide normals are never zero
+			float invW = 1.0f / sumW[x];
+			out.r[p] = sumR[x] * invW;
+			out.g[p] = sumG[x] * invW;
+			out.b[p] = sumB[x] * invW;
+			out.variance[p] = sumV[x] * invW * invW;
+		}
+	}
+
+	// Adds the tap at (x + offset, qy) to the sums of pixels x0 .. x1-1 of row y
+	void Tap(int y, int qy, int offset, int x0, int x1, float h, float invDistance, const Planes& in,
+		float* sumR, float* sumG, float* sumB, float* sumW, float* sumV) const
+	{
+		const size_t rowP = size_t(y) * width;
+		const size_t rowQ = size_t(qy) * width + offset;
+		int x = x0;
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		const __m256 hv = _mm256_set1_ps(h);
+		const __m256 invDistanceV = _mm256_set1_ps(invDistance);
+		const __m256 lr = _mm256_set1_ps(0.2126f), lg = _mm256_set1_ps(0.7152f), lb = _mm256_set1_ps(0.0722f);
+		for (; x + 8 <= x1; x += 8)
+		{
+			size_t p = rowP + x, q = rowQ + x;
+			__m256 dot = _mm256_mul_ps(_mm256_loadu_ps(&nx[p]), _mm256_loadu_ps(&nx[q]));
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(&ny[p]), _mm256_loadu_ps(&ny[q])));
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(&nz[p]), _mm256_loadu_ps(&nz[q])));
+			__m256 normalWeight = _mm256_max_ps(dot, zero);
+			for (int i = 0; i < normalSquarings; i++) normalWeight = _mm256_mul_ps(normalWeight, normalWeight);
+
+			__m256 depthDelta = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(&depth[p]), _mm256_loadu_ps(&depth[q])), signMask);
+			__m256 depthTerm = _mm256_mul_ps(_mm256_mul_ps(depthDelta, _mm256_loadu_ps(&depthScale[p])), invDistanceV);
+
+			__m256 rq = _mm256_loadu_ps(&in.r[q]), gq = _mm256_loadu_ps(&in.g[q]), bq = _mm256_loadu_ps(&in.b[q]);
+			__m256 lp = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&in.r[p]), lr), _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&in.g[p]), lg), _mm256_mul_ps(_mm256_loadu_ps(&in.b[p]), lb)));
+			__m256 lq = _mm256_add_ps(_mm256_mul_ps(rq, lr), _mm256_add_ps(_mm256_mul_ps(gq, lg), _mm256_mul_ps(bq, lb)));
+			__m256 luminanceTerm = _mm256_mul_ps(_mm256_and_ps(_mm256_sub_ps(lp, lq), signMask), _mm256_loadu_ps(&luminanceScale[p]));
+
+			__m256 w = _mm256_mul_ps(_mm256_mul_ps(hv, normalWeight), FastExp(_mm256_sub_ps(zero, _mm256_add_ps(depthTerm, luminanceTerm))));
+			_mm256_storeu_ps(&sumR[x], _mm256_add_ps(_mm256_loadu_ps(&sumR[x]), _mm256_mul_ps(w, rq)));
+			_mm256_storeu_ps(&sumG[x], _mm256_add_ps(_mm256_loadu_ps(&sumG[x]), _mm256_mul_ps(w, gq)));
+			_mm256_storeu_ps(&sumB[x], _mm256_add_ps(_mm256_loadu_ps(&sumB[x]), _mm256_mul_ps(w, bq)));
+			_mm256_storeu_ps(&sumW[x], _mm256_add_ps(_mm256_loadu_ps(&sumW[x]), w));
+			_mm256_storeu_ps(&sumV[x], _mm256_add_ps(_mm256_loadu_ps(&sumV[x]), _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_loadu_ps(&in.variance[q]))));
+		}
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 hv = _mm_set1_ps(h);
+		const __m128 invDistanceV = _mm_set1_ps(invDistance);
+		const __m128 lr = _mm_set1_ps(0.2126f), lg = _mm_set1_ps(0.7152f), lb = _mm_set1_ps(0.0722f);
+		for (; x + 4 <= x1; x += 4)
+		{
+			size_t p = rowP + x, q = rowQ + x;
+			__m128 dot = _mm_mul_ps(_mm_loadu_ps(&nx[p]), _mm_loadu_ps(&nx[q]));
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(&ny[p]), _mm_loadu_ps(&ny[q])));
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(&nz[p]), _mm_loadu_ps(&nz[q])));
+			__m128 normalWeight = _mm_max_ps(dot, zero);
+			for (int i = 0; i < normalSquarings; i++) normalWeight = _mm_mul_ps(normalWeight, normalWeight);
+
+			__m128 depthDelta = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&depth[p]), _mm_loadu_ps(&depth[q])), signMask);
+			__m128 depthTerm = _mm_mul_ps(_mm_mul_ps(depthDelta, _mm_loadu_ps(&depthScale[p])), invDistanceV);
+
+			__m128 rq = _mm_loadu_ps(&in.r[q]), gq = _mm_loadu_ps(&in.g[q]), bq = _mm_loadu_ps(&in.b[q]);
+			__m128 lp = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&in.r[p]), lr), _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&in.g[p]), lg), _mm_mul_ps(_mm_loadu_ps(&in.b[p]), lb)));
+			__m128 lq = _mm_add_ps(_mm_mul_ps(rq, lr), _mm_add_ps(_mm_mul_ps(gq, lg), _mm_mul_ps(bq, lb)));
+			__m128 luminanceTerm = _mm_mul_ps(_mm_and_ps(_mm_sub_ps(lp, lq), signMask), _mm_loadu_ps(&luminanceScale[p]));
+
+			__m128 w = _mm_mul_ps(_mm_mul_ps(hv, normalWeight), FastExp(_mm_sub_ps(zero, _mm_add_ps(depthTerm, luminanceTerm))));
+			_mm_storeu_ps(&sumR[x], _mm_add_ps(_mm_loadu_ps(&sumR[x]), _mm_mul_ps(w, rq)));
+			_mm_storeu_ps(&sumG[x], _mm_add_ps(_mm_loadu_ps(&sumG[x]), _mm_mul_ps(w, gq)));
+			_mm_storeu_ps(&sumB[x], _mm_add_ps(_mm_loadu_ps(&sumB[x]), _mm_mul_ps(w, bq)));
+			_mm_storeu_ps(&sumW[x], _mm_add_ps(_mm_loadu_ps(&sumW[x]), w));
+			_mm_storeu_ps(&sumV[x], _mm_add_ps(_mm_loadu_ps(&sumV[x]), _mm_mul_ps(_mm_mul_ps(w, w), _mm_loadu_ps(&in.variance[q]))));
+		}
+#endif
+		// Remaining pixels, and every pixel in the scalar build
+		for (; x < x1; x++)
+		{
+			size_t p = rowP + x, q = rowQ + x;
+			float normalWeight = std::max(0.0f, nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q]);
+			for (int i = 0; i < normalSquarings; i++) normalWeight *= normalWeight;
+			float depthTerm = std::fabs(depth[p] - depth[q]) * depthScale[p] * invDistance;
+			float luminanceTerm = std::fabs(Luminance(in.r[p], in.g[p], in.b[p]) - Luminance(in.r[q], in.g[q], in.b[q])) * luminanceScale[p];
+			float w = h * normalWeight * FastExp(-(depthTerm + luminanceTerm));
+			sumR[x] += w * in.r[q];
+			sumG[x] += w * in.g[q];
+			sumB[x] += w * in.b[q];
+			sumW[x] += w;
+			sumV[x] += w * w * in.variance[q];
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef ENCODE_QUEUE_H
+#define ENCODE_QUEUE_H
+
+#include "ImageWriter.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Background threads that save finished 8 bit RGB images while the render workers move on.
+/// PNGs are split into strips (see EncodePngStrip) that the threads compress in parallel; the
+/// thread finishing the last strip of an image writes the file. QOI and PPM images are one job
+/// each. Push() hands an image over and returns at once unless maxPending images are already
+/// waiting, which bounds the memory a slow disk or encoder can tie up.
+/// </summary>
+class EncodeQueue
+{
+public:
+	// threadCount 0 uses every hardware thread
+	explicit EncodeQueue(int threadCount = 0, int maxPending = 2) : maxPending(std::max(1, maxPending))
+	{
+		if (threadCount <= 0) threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+		for (int t = 0; t < threadCount; t++) threads.emplace_back(&EncodeQueue::WorkerLoop, this, t);
+	}
+	~EncodeQueue() { Finish(); }
+
+	EncodeQueue(const EncodeQueue&) = delete;
+	EncodeQueue& operator=(const EncodeQueue&) = delete;
+
+	int ThreadCount() const { return int(threads.size()); }
+
+	/// <summary>
+	/// Queues imageData (malloc'd, width * height * 3 bytes, as Camera::Render() returns it) to be
+	/// written to path in the format of its extension. The queue owns it from here and frees it
+	/// once it is written.
+	/// </summary>
+	void Push(const std::string& path, int width, int height, uint8_t* imageData)
+	{
+		std::shared_ptr<Image> image(new Image());
+		image->path = path;
+		image->width = width;
+		image->height = height;
+		image->data = imageData;
+		image->format = ImageFormatFor(path);
+		int jobs = image->format == ImageFormat::Png ? PngStripCount(height) : 1;
+		if (image->format == ImageFormat::Png) image->strips.resize(jobs);
+		image->remaining = jobs;
+
+		TraceScope trace("wait for encoder", "encode");
+		auto start = std::chrono::high_resolution_clock::now();
+		std::unique_lock<std::mutex> lock(mutex);
+		space.wait(lock, [&]() { return inFlight < maxPending; });
+		stallSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		inFlight++;
+		for (int j = 0; j < jobs; j++) pending.push_back(Job{ image, j });
+		work.notify_all();
+	}
+
+	// Blocks until every image pushed so far is written. Returns false if any failed
+	bool Wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		space.wait(lock, [&]() { return inFlight == 0; });
+		return failures == 0;
+	}
+
+	/// <summary>
+	/// Writes every queued image and stops the threads. Returns false if any image could not be
+	/// written. No images can be pushed afterwards.
+	/// </summary>
+	bool Finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work.notify_all();
+		for (auto& t : threads)
+			if (t.joinable()) t.join();
+		return failures == 0;
+	}
+
+	// Images written so far, and those that failed
+	int Written() const { std::lock_guard<std::mutex> lock(mutex); return written; }
+	int Failures() const { std::lock_guard<std::mutex> lock(mutex); return failures; }
+	// Time Push() spent waiting for a free slot, render time lost to encoding
+	double StallSeconds() const { std::lock_guard<std::mutex> lock(mutex); return stallSeconds; }
+
+private:
+	struct Image
+	{
+		std::string path;
+		int width = 0;
+		int height = 0;
+		uint8_t* data = nullptr;
+		ImageFormat format = ImageFormat::Png;
+		std::vector<PngStrip> strips;
+		bool failed = false;
+		int remaining = 0;	// Jobs not finished yet, under the queue's mutex
+	};
+	struct Job
+	{
+		std::shared_ptr<Image> image;
+		int strip;
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable work;
+	std::condition_variable space;
+	std::deque<Job> pending;
+	std::vector<std::thread> threads;
+	int maxPending;
+	int inFlight = 0;
+	bool stopping = false;
+	int written = 0;
+	int failures = 0;
+	double stallSeconds = 0;
+
+	void WorkerLoop(int index)
+	{
+		GlobalTracer().NameThread("encoder " + std::to_string(index));
+		while (true)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work.wait(lock, [&]() { return stopping || !pending.empty(); });
+				if (pending.empty()) return;
+				job = pending.front();
+				pending.pop_front();
+			}
+
+			Image& image = *job.image;
+			bool ok = true;
+			{
+				TraceScope trace(image.format == ImageFormat::Png ? "png strip" : image.format == ImageFormat::Qoi ? "qoi" : "ppm", "encode", "strip", job.strip);
+				if (image.format == ImageFormat::Png) ok = EncodePngStrip(image.data, image.width, image.height, job.strip, image.strips[job.strip]);
+				else if (image.format == ImageFormat::Qoi) ok = WriteBytes(image.path, EncodeQoi(image.data, image.width, image.height));
+				else ok = WritePpm(image.path, image.width, image.height, image.data);
+			}
+
+			bool lastJob;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				image.failed |= !ok;
+				lastJob = --image.remaining == 0;
+			}
+			if (!lastJob) continue;
+
+			if (image.format == ImageFormat::Png && !image.failed)
+			{
+				TraceScope trace("write png", "encode", "strips", int(image.strips.size()));
+				image.failed = !WritePngStrips(image.path, image.width, image.height, image.strips);
+			}
+			free(image.data);
+			image.data = nullptr;
+			image.strips.clear();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (image.failed) failures++;
+				else written++;
+				inFlight--;
+			}
+			space.notify_all();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef HDR_IMAGE_H
+#define HDR_IMAGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// One named layer of an EXR file: channels floats per pixel, interleaved, with a channel name
+/// for each, e.g. { "normal", { "X", "Y", "Z" }, data } becomes normal.X, normal.Y and normal.Z.
+/// An empty layer name gives bare channel names, which is what viewers expect for R, G and B.
+/// </summary>
+struct ExrLayer
+{
+	std::string name;
+	std::vector<std::string> channels;
+	const float* data;
+};
+
+/// <summary>
+/// Writes a single part, uncompressed scanline OpenEXR file with 32 bit float channels, so the
+/// values are stored exactly. Returns false if the file can't be written.
+/// </summary>
+inline bool WriteExr(const std::string& path, int width, int height, const std::vector<ExrLayer>& layers)
+{
+	struct Channel
+	{
+		std::string name;
+		const float* data;
+		int stride;
+	};
+	std::vector<Channel> channels;
+	for (const ExrLayer& layer : layers)
+	{
+		int stride = int(layer.channels.size());
+		for (int c = 0; c < stride; c++)
+			channels.push_back(Channel{ layer.name.empty() ? layer.channels[c] : layer.name + "." + layer.channels[c], layer.data + c, stride });
+	}
+	// The format wants channels sorted by name, in the header and in every scanline
+	std::sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+	std::vector<uint8_t> header;
+	auto put = [&](const void* bytes, size_t size) { header.insert(header.end(), (const uint8_t*)bytes, (const uint8_t*)bytes + size); };
+	auto putInt = [&](int32_t value) { put(&value, 4); };
+	auto putFloat = [&](float value) { put(&value, 4); };
+	auto putString = [&](const std::string& s) { put(s.c_str(), s.size() + 1); };
+	auto attribute = [&](const char* name, const char* type, int32_t size)
+	{
+		putString(name);
+		putString(type);
+		putInt(size);
+	};
+
+	const uint8_t magic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+	put(magic, 4);
+	putInt(2);	// Version 2, single part scanline
+
+	int32_t channelListSize = 1;
+	for (const Channel& c : channels) channelListSize += int32_t(c.name.size()) + 1 + 16;
+	attribute("channels", "chlist", channelListSize);
+	for (const Channel& c : channels)
+	{
+		putString(c.name);
+		putInt(2);	// FLOAT
+		putInt(0);	// pLinear and reserved bytes
+		putInt(1);	// x sampling
+		putInt(1);	// y sampling
+	}
+	header.push_back(0);
+
+	attribute("compression", "compression", 1);
+	header.push_back(0);	// NO_COMPRESSION
+	for (const char* window : { "dataWindow", "displayWindow" })
+	{
+		attribute(window, "box2i", 16);
+		putInt(0);
+		putInt(0);
+		putInt(width - 1);
+		putInt(height - 1);
+	}
+	attribute("lineOrder", "lineOrder", 1);
+	header.push_back(0);	// INCREASING_Y
+	attribute("pixelAspectRatio", "float", 4);
+	putFloat(1.0f);
+	attribute("screenWindowCenter", "v2f", 8);
+	putFloat(0.0f);
+	putFloat(0.0f);
+	attribute("screenWindowWidth", "float", 4);
+	putFloat(1.0f);
+	header.push_back(0);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	fwrite(header.data(), 1, header.size(), file);
+
+	// Offset table, then each scanline as its y, its byte count and one row per channel
+	const int32_t lineBytes = int32_t(width * channels.size() * sizeof(float));
+	uint64_t offset = header.size() + uint64_t(height) * 8;
+	for (int y = 0; y < height; y++, offset += 8 + lineBytes) fwrite(&offset, 8, 1, file);
+
+	std::vector<float> row(width);
+	bool ok = true;
+	for (int32_t y = 0; y < height && ok; y++)
+	{
+		fwrite(&y, 4, 1, file);
+		fwrite(&lineBytes, 4, 1, file);
+		for (const Channel& c : channels)
+		{
+			for (int x = 0; x < width; x++) row[x] = c.data[(size_t(y) * width + x) * c.stride];
+			ok = fwrite(row.data(), sizeof(float), width, file) == size_t(width);
+		}
+	}
+	return fclose(file) == 0 && ok;
+}
+
+/// <summary>
+/// Writes a Portable Float Map: greyscale for 1 channel, RGB for 3. Rows go bottom to top and the
+/// negative scale marks the floats as little endian.
+/// </summary>
+inline bool WritePfm(const std::string& path, int width, int height, int channels, const float* data)
+{
+	if (channels != 1 && channels != 3) return false;
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	fprintf(file, "%s\n%d %d\n-1.0\n", channels == 3 ? "PF" : "Pf", width, height);
+
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--)
+		ok = fwrite(data + size_t(y) * width * channels, sizeof(float), size_t(width) * channels, file) == size_t(width) * channels;
+	return fclose(file) == 0 && ok;
+}
+
+#endif
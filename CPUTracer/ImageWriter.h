@@ -0,0 +1,401 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+// Camera.h compiles the stb implementation; including the header again after it would repeat it
+#ifndef INCLUDE_STB_IMAGE_WRITE_H
+#include "stb_image_write.h"
+#endif
+#include "Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// File formats for 8 bit RGB output. PNG is what the viewer wants; QOI and PPM are for scratch
+/// output, QOI is several times faster to encode than PNG at a similar size and PPM is the raw pixels.
+/// </summary>
+enum class ImageFormat { Png, Qoi, Ppm };
+
+// Picks the format from the extension of path, PNG for anything it doesn't know
+inline ImageFormat ImageFormatFor(const std::string& path)
+{
+	auto endsWith = [&](const char* ext)
+	{
+		size_t n = strlen(ext);
+		if (path.size() < n) return false;
+		for (size_t i = 0; i < n; i++)
+			if (tolower((unsigned char)path[path.size() - n + i]) != ext[i]) return false;
+		return true;
+	};
+	if (endsWith(".qoi")) return ImageFormat::Qoi;
+	if (endsWith(".ppm")) return ImageFormat::Ppm;
+	return ImageFormat::Png;
+}
+
+inline uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+	struct Table
+	{
+		uint32_t entries[256];
+		Table()
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				entries[n] = c;
+			}
+		}
+	};
+	static const Table table;
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+/// <summary>
+/// Adler-32 of two buffers back to back from the checksums of each, the second lengthB bytes
+/// long (zlib's adler32_combine).
+/// </summary>
+inline uint32_t Adler32Combine(uint32_t a, uint32_t b, size_t lengthB)
+{
+	const uint32_t base = 65521;
+	uint32_t rem = uint32_t(lengthB % base);
+	uint32_t sum1 = a & 0xffff;
+	uint32_t sum2 = uint32_t(uint64_t(rem) * sum1 % base);
+	sum1 += (b & 0xffff) + base - 1;
+	sum2 += ((a >> 16) & 0xffff) + ((b >> 16) & 0xffff) + base - rem;
+	if (sum1 >= base) sum1 -= base;
+	if (sum1 >= base) sum1 -= base;
+	if (sum2 >= base << 1) sum2 -= base << 1;
+	if (sum2 >= base) sum2 -= base;
+	return sum1 | (sum2 << 16);
+}
+
+/// <summary>
+/// PNG encoding split into strips of pngStripRows rows that compress independently, so each strip
+/// can go to its own thread. Every strip becomes one IDAT chunk holding its own deflate blocks,
+/// which only refer back inside the strip; the chunks of an image joined in order are one valid
+/// zlib stream. The strip size is fixed, so the file is the same whatever the thread count.
+/// </summary>
+const int pngStripRows = 64;
+
+inline int PngStripCount(int height) { return (height + pngStripRows - 1) / pngStripRows; }
+
+struct PngStrip
+{
+	std::vector<uint8_t> chunk;	// The whole IDAT chunk: length, tag, data and CRC
+	uint32_t adler = 1;			// Adler-32 of the filtered rows
+	size_t length = 0;			// Bytes of filtered rows
+};
+
+namespace PngDetail
+{
+	inline void Put32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		uint8_t b[4] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) };
+		out.insert(out.end(), b, b + 4);
+	}
+	// Wraps data as a chunk of type tag, with its length and CRC
+	inline void PutChunk(std::vector<uint8_t>& out, const char* tag, const uint8_t* data, size_t size)
+	{
+		Put32(out, uint32_t(size));
+		size_t start = out.size();
+		out.insert(out.end(), tag, tag + 4);
+		if (size) out.insert(out.end(), data, data + size);
+		Put32(out, Crc32(out.data() + start, size + 4));
+	}
+	inline int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		if (pa <= pb && pa <= pc) return a;
+		return pb <= pc ? b : c;
+	}
+	/// <summary>
+	/// Filters one row of RGB pixels (prior is the row above, or null for the first) with the
+	/// filter that gives the smallest sum of absolute differences, the same choice stb makes.
+	/// Writes the filter type byte and the row to out.
+	/// </summary>
+	inline void FilterRow(const uint8_t* row, const uint8_t* prior, int rowBytes, uint8_t* out, std::vector<uint8_t>& scratch)
+	{
+		const int bpp = 3;
+		scratch.resize(size_t(rowBytes) * 5);
+		int best = 0;
+		long long bestSum = -1;
+		for (int type = 0; type < 5; type++)
+		{
+			uint8_t* line = &scratch[size_t(rowBytes) * type];
+			long long sum = 0;
+			for (int i = 0; i < rowBytes; i++)
+			{
+				int a = i >= bpp ? row[i - bpp] : 0;
+				int b = prior ? prior[i] : 0;
+				int c = prior && i >= bpp ? prior[i - bpp] : 0;
+				int predicted = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) >> 1 : Paeth(a, b, c);
+				line[i] = uint8_t(row[i] - predicted);
+				sum += abs(int8_t(line[i]));
+			}
+			if (bestSum < 0 || sum < bestSum)
+			{
+				bestSum = sum;
+				best = type;
+			}
+		}
+		out[0] = uint8_t(best);
+		memcpy(out + 1, &scratch[size_t(rowBytes) * best], rowBytes);
+	}
+	/// <summary>
+	/// Bit length of the single fixed Huffman block stb_image_write's compressor emits, up to and
+	/// including its end of block code, by walking its codes.
+	/// </summary>
+	inline size_t FixedBlockBits(const uint8_t* data, size_t size)
+	{
+		static const uint8_t lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+		static const uint8_t distanceExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+		size_t bit = 3;
+		size_t end = size * 8;
+		auto next = [&]() { int b = bit < end ? (data[bit >> 3] >> (bit & 7)) & 1 : 0; bit++; return b; };
+		// Huffman codes are stored first bit first, extra bits least significant bit first
+		auto code = [&](int bits) { int v = 0; for (int i = 0; i < bits; i++) v = (v << 1) | next(); return v; };
+		auto extra = [&](int bits) { for (int i = 0; i < bits; i++) next(); };
+		while (bit < end)
+		{
+			int symbol;
+			int v = code(7);
+			if (v <= 0x17) symbol = 256 + v;
+			else
+			{
+				v = (v << 1) | next();
+				if (v >= 0x30 && v <= 0xbf) symbol = v - 0x30;
+				else if (v >= 0xc0 && v <= 0xc7) symbol = 280 + v - 0xc0;
+				else symbol = 144 + (((v << 1) | next()) - 0x190);
+			}
+			if (symbol == 256) return bit;
+			if (symbol > 256)
+			{
+				extra(lengthExtra[symbol - 257]);
+				extra(distanceExtra[code(5)]);
+			}
+		}
+		return end;
+	}
+}
+
+/// <summary>
+/// Filters and compresses rows [strip * pngStripRows, ...) of a width x height RGB image into an
+/// IDAT chunk. The first strip starts the zlib stream; every strip but the last ends on a byte
+/// boundary, with an empty stored block the way zlib's sync flush does when it was compressed,
+/// so the next can follow it.
+/// </summary>
+inline bool EncodePngStrip(const uint8_t* rgb, int width, int height, int strip, PngStrip& out)
+{
+	const int rowBytes = width * 3;
+	const int y0 = strip * pngStripRows;
+	const int y1 = std::min(height, y0 + pngStripRows);
+	const bool last = y1 == height;
+
+	std::vector<uint8_t> filtered(size_t(rowBytes + 1) * (y1 - y0));
+	std::vector<uint8_t> scratch;
+	for (int y = y0; y < y1; y++)
+	{
+		const uint8_t* row = rgb + size_t(y) * rowBytes;
+		PngDetail::FilterRow(row, y > 0 ? row - rowBytes : nullptr, rowBytes, &filtered[size_t(y - y0) * (rowBytes + 1)], scratch);
+	}
+
+	int zlibSize = 0;
+	uint8_t* zlib = stbi_zlib_compress(filtered.data(), int(filtered.size()), &zlibSize, stbi_write_png_compression_level);
+	if (!zlib) return false;
+	out.length = filtered.size();
+	out.adler = (uint32_t(zlib[zlibSize - 4]) << 24) | (uint32_t(zlib[zlibSize - 3]) << 16) | (uint32_t(zlib[zlibSize - 2]) << 8) | zlib[zlibSize - 1];
+
+	// Raw deflate data between the 2 byte zlib header and the Adler-32
+	std::vector<uint8_t> data;
+	if (strip == 0) data.insert(data.end(), zlib, zlib + 2);
+	size_t start = data.size();
+	data.insert(data.end(), zlib + 2, zlib + zlibSize - 4);
+	free(zlib);
+	uint8_t* deflate = data.data() + start;
+	size_t deflateSize = data.size() - start;
+
+	if (!last)
+	{
+		if (((deflate[0] >> 1) & 3) == 1)
+		{
+			// One fixed Huffman block padded to a byte: clear BFINAL and, after the end of block
+			// code, start an empty stored block. Its 3 header bits are zero, so they fit in the
+			// padding when there are 3 bits of it or spill into one more zero byte when not.
+			deflate[0] &= 0xfe;
+			size_t bits = PngDetail::FixedBlockBits(deflate, deflateSize);
+			if (deflateSize * 8 - bits < 3) data.push_back(0);
+			const uint8_t emptyStored[4] = { 0x00, 0x00, 0xff, 0xff };
+			data.insert(data.end(), emptyStored, emptyStored + 4);
+		}
+		else
+		{
+			// stb fell back to stored blocks, which end byte aligned so the next strip can follow
+			// straight on. Clear BFINAL on the last one.
+			size_t p = 0;
+			while (p + 5 <= deflateSize)
+			{
+				size_t blockLength = deflate[p + 1] | (deflate[p + 2] << 8);
+				if (p + 5 + blockLength >= deflateSize)
+				{
+					deflate[p] &= 0xfe;
+					break;
+				}
+				p += 5 + blockLength;
+			}
+		}
+	}
+
+	out.chunk.clear();
+	PngDetail::PutChunk(out.chunk, "IDAT", data.data(), data.size());
+	return true;
+}
+
+/// <summary>
+/// Writes the PNG made of strips from EncodePngStrip, all of them, in order
+/// </summary>
+inline bool WritePngStrips(const std::string& path, int width, int height, const std::vector<PngStrip>& strips)
+{
+	std::vector<uint8_t> head = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::vector<uint8_t> ihdr;
+	PngDetail::Put32(ihdr, uint32_t(width));
+	PngDetail::Put32(ihdr, uint32_t(height));
+	const uint8_t format[5] = { 8, 2, 0, 0, 0 };	// 8 bit RGB, deflate, no interlace
+	ihdr.insert(ihdr.end(), format, format + 5);
+	PngDetail::PutChunk(head, "IHDR", ihdr.data(), ihdr.size());
+
+	uint32_t adler = 1;
+	for (const PngStrip& strip : strips) adler = Adler32Combine(adler, strip.adler, strip.length);
+	std::vector<uint8_t> tail;
+	std::vector<uint8_t> adlerBytes;
+	PngDetail::Put32(adlerBytes, adler);
+	PngDetail::PutChunk(tail, "IDAT", adlerBytes.data(), 4);
+	PngDetail::PutChunk(tail, "IEND", nullptr, 0);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	bool ok = fwrite(head.data(), 1, head.size(), file) == head.size();
+	for (const PngStrip& strip : strips)
+		ok = ok && fwrite(strip.chunk.data(), 1, strip.chunk.size(), file) == strip.chunk.size();
+	ok = ok && fwrite(tail.data(), 1, tail.size(), file) == tail.size();
+	return fclose(file) == 0 && ok;
+}
+
+/// <summary>
+/// Encodes RGB pixels as QOI (qoiformat.org): runs, a 64 entry cache of recent colours and small
+/// deltas, one pass with no entropy coding.
+/// </summary>
+inline std::vector<uint8_t> EncodeQoi(const uint8_t* rgb, int width, int height)
+{
+	std::vector<uint8_t> out;
+	out.reserve(size_t(width) * height * 4 / 3 + 22);
+	const uint8_t header[4] = { 'q', 'o', 'i', 'f' };
+	out.insert(out.end(), header, header + 4);
+	PngDetail::Put32(out, uint32_t(width));
+	PngDetail::Put32(out, uint32_t(height));
+	out.push_back(3);	// RGB
+	out.push_back(0);	// sRGB
+
+	// Entries start as transparent black, which no pixel here matches since they are all opaque
+	uint8_t index[64][4] = {};
+	uint8_t previous[3] = { 0, 0, 0 };
+	int run = 0;
+	size_t pixels = size_t(width) * height;
+	for (size_t p = 0; p < pixels; p++)
+	{
+		const uint8_t* c = rgb + p * 3;
+		if (c[0] == previous[0] && c[1] == previous[1] && c[2] == previous[2])
+		{
+			if (++run == 62 || p + 1 == pixels)
+			{
+				out.push_back(uint8_t(0xc0 | (run - 1)));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			out.push_back(uint8_t(0xc0 | (run - 1)));
+			run = 0;
+		}
+
+		int slot = (c[0] * 3 + c[1] * 5 + c[2] * 7 + 255 * 11) % 64;
+		if (index[slot][0] == c[0] && index[slot][1] == c[1] && index[slot][2] == c[2] && index[slot][3] == 255)
+			out.push_back(uint8_t(slot));
+		else
+		{
+			memcpy(index[slot], c, 3);
+			index[slot][3] = 255;
+			int dr = int8_t(c[0] - previous[0]);
+			int dg = int8_t(c[1] - previous[1]);
+			int db = int8_t(c[2] - previous[2]);
+			int drg = dr - dg, dbg = db - dg;
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				out.push_back(uint8_t(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+			else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+			{
+				out.push_back(uint8_t(0x80 | (dg + 32)));
+				out.push_back(uint8_t(((drg + 8) << 4) | (dbg + 8)));
+			}
+			else
+			{
+				out.push_back(0xfe);
+				out.insert(out.end(), c, c + 3);
+			}
+		}
+		memcpy(previous, c, 3);
+	}
+	const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	out.insert(out.end(), end, end + 8);
+	return out;
+}
+
+inline bool WriteBytes(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return fclose(file) == 0 && ok;
+}
+
+// Binary PPM, the RGB bytes after a text header
+inline bool WritePpm(const std::string& path, int width, int height, const uint8_t* rgb)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	size_t size = size_t(width) * height * 3;
+	bool ok = fwrite(rgb, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+/// <summary>
+/// Saves RGB pixels on the calling thread in the format of path's extension. EncodeQueue does the
+/// same with the PNG strips spread over its threads.
+/// </summary>
+inline bool WriteImage(const std::string& path, int width, int height, const uint8_t* rgb)
+{
+	TraceScope trace("write image", "encode", "width", width, "height", height);
+	switch (ImageFormatFor(path))
+	{
+	case ImageFormat::Qoi: return WriteBytes(path, EncodeQoi(rgb, width, height));
+	case ImageFormat::Ppm: return WritePpm(path, width, height, rgb);
+	default:
+	{
+		std::vector<PngStrip> strips(PngStripCount(height));
+		for (int s = 0; s < int(strips.size()); s++)
+			if (!EncodePngStrip(rgb, width, height, s, strips[s])) return false;
+		return WritePngStrips(path, width, height, strips);
+	}
+	}
+}
+
+#endif
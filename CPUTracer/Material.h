@@ -3,66 +3,220 @@
 
 #include "RenderedObject.h"
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+
+class Material;
+
+// Concrete type of a Material, lets batched code dispatch without a virtual call
+enum class MaterialType
+{
+	None,
+	Lambertian,
+	Metal,
+	Emmisive,
+	Count
+};
+
+/// <summary>
+/// Plain data copy of a material that the integrators shade with. Dispatch is a switch on type
+/// instead of a virtual call. Materials without a built in type keep a pointer back to the object.
+/// </summary>
+struct MaterialRecord
+{
+	MaterialType type;
+	Vec3 albedo;
+	Vec3 emmision;
+	const Material* object;	// Only used by MaterialType::None
+};
+
+// Bounce directions shared by the Material classes and the record dispatch
+inline Ray DiffuseRay(const HitInfo& hit, Sampler& sampler)
+{
+	Vec3 scatterDirection = hit.normal + RandomUnitVector(sampler);
+
+	if (scatterDirection.NearZero()) scatterDirection = hit.normal;
+
+	return Ray(hit.p, scatterDirection);
+}
+inline Ray MirrorRay(const Ray& r, const HitInfo& hit)
+{
+	return Ray(hit.p, Reflect(r.Direction(), hit.normal));
+}
+
 class Material
 {
 public:
+	const MaterialType type;
+
+	Material(MaterialType type = MaterialType::None) : type(type) {}
 	virtual ~Material() = default;
 
-	virtual bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered) const
+	virtual bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered, Sampler& sampler) const
 	{
 		return false;
 	}
+	virtual MaterialRecord Record() const
+	{
+		return MaterialRecord{ type, Vec3(0, 0, 0), Vec3(0, 0, 0), this };
+	}
 };
 
 class Lambertian : public Material
 {
 public:
 	Vec3 albedo;
-	Lambertian(const Vec3& albedo) : albedo(albedo) {}
+	Lambertian(const Vec3& albedo) : Material(MaterialType::Lambertian), albedo(albedo) {}
 
-	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered) const override
+	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered, Sampler& sampler) const override
 	{
-		Vec3 scatterDirection = hit.normal + RandomUnitVector();
-
-		if (scatterDirection.NearZero()) scatterDirection = hit.normal;
-
-		scattered = Ray(hit.p, scatterDirection);
+		scattered = DiffuseRay(hit, sampler);
 		attenuation = albedo;
 		return true;
 	}
+	MaterialRecord Record() const override
+	{
+		return MaterialRecord{ type, albedo, Vec3(0, 0, 0), this };
+	}
 };
 
 class Metal : public Material
 {
 public:
 	Vec3 albedo;
-	Metal(const Vec3& albedo) : albedo(albedo) {}
-	
-	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered) const override
+	Metal(const Vec3& albedo) : Material(MaterialType::Metal), albedo(albedo) {}
+
+	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered, Sampler& sampler) const override
 	{
-		Vec3 reflected = Reflect(r.Direction(), hit.normal);
-		scattered = Ray(hit.p, reflected);
+		scattered = MirrorRay(r, hit);
 		attenuation = albedo;
 		return true;
 	}
+	MaterialRecord Record() const override
+	{
+		return MaterialRecord{ type, albedo, Vec3(0, 0, 0), this };
+	}
 };
 class Emmisive : public Material
 {
 public:
 	Vec3 albedo;
 	Vec3 emmision;
-	Emmisive(const Vec3& albedo, const Vec3& emmision) : albedo(albedo), emmision(emmision) {}
+	Emmisive(const Vec3& albedo, const Vec3& emmision) : Material(MaterialType::Emmisive), albedo(albedo), emmision(emmision) {}
 
-	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered) const override
+	bool Scatter(const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered, Sampler& sampler) const override
 	{
-		Vec3 scatterDirection = hit.normal + RandomUnitVector();
-
-		if (scatterDirection.NearZero()) scatterDirection = hit.normal;
-
-		scattered = Ray(hit.p, scatterDirection);
+		scattered = DiffuseRay(hit, sampler);
 		attenuation = albedo + emmision;
 		return true;
 	}
+	MaterialRecord Record() const override
+	{
+		return MaterialRecord{ type, albedo, emmision, this };
+	}
+};
+
+/// <summary>
+/// Same result as the Material's own Scatter, dispatched with a switch so it can be inlined.
+/// </summary>
+inline bool Scatter(const MaterialRecord& mat, const Ray& r, const HitInfo& hit, Vec3& attenuation, Ray& scattered, Sampler& sampler)
+{
+	switch (mat.type)
+	{
+	case MaterialType::Lambertian:
+		scattered = DiffuseRay(hit, sampler);
+		attenuation = mat.albedo;
+		return true;
+	case MaterialType::Metal:
+		scattered = MirrorRay(r, hit);
+		attenuation = mat.albedo;
+		return true;
+	case MaterialType::Emmisive:
+		scattered = DiffuseRay(hit, sampler);
+		attenuation = mat.albedo + mat.emmision;
+		return true;
+	default:
+		return mat.object && mat.object->Scatter(r, hit, attenuation, scattered, sampler);
+	}
+}
+
+// Colour a hit multiplies the light it bounces by, what the denoiser divides out before filtering
+inline Vec3 GuideAlbedo(const MaterialRecord& mat)
+{
+	switch (mat.type)
+	{
+	case MaterialType::Lambertian:
+	case MaterialType::Metal:
+		return mat.albedo;
+	case MaterialType::Emmisive:
+		return mat.albedo + mat.emmision;
+	default:
+		return Vec3(1, 1, 1);
+	}
+}
+
+/// <summary>
+/// Scatters count hits whose materials all have the given type, hit i arriving along rays[i]
+/// and drawing from samplers[i].
+/// The type switch sits outside the loops, so each case is a straight loop over separate input
+/// and output arrays. scatters[i] is set to 0 where the path ends.
+/// </summary>
+inline void ScatterN(MaterialType type, int count, const MaterialRecord* records, const Ray* rays, const HitInfo* hits,
+	Vec3* attenuation, Ray* scattered, uint8_t* scatters, Sampler* samplers)
+{
+	switch (type)
+	{
+	case MaterialType::Lambertian:
+		for (int i = 0; i < count; i++) attenuation[i] = records[hits[i].materialId].albedo;
+		for (int i = 0; i < count; i++) scattered[i] = DiffuseRay(hits[i], samplers[i]);
+		for (int i = 0; i < count; i++) scatters[i] = 1;
+		break;
+	case MaterialType::Metal:
+		for (int i = 0; i < count; i++) attenuation[i] = records[hits[i].materialId].albedo;
+		for (int i = 0; i < count; i++) scattered[i] = MirrorRay(rays[i], hits[i]);
+		for (int i = 0; i < count; i++) scatters[i] = 1;
+		break;
+	case MaterialType::Emmisive:
+		for (int i = 0; i < count; i++)
+		{
+			const MaterialRecord& mat = records[hits[i].materialId];
+			attenuation[i] = mat.albedo + mat.emmision;
+		}
+		for (int i = 0; i < count; i++) scattered[i] = DiffuseRay(hits[i], samplers[i]);
+		for (int i = 0; i < count; i++) scatters[i] = 1;
+		break;
+	default:
+		for (int i = 0; i < count; i++) scatters[i] = Scatter(records[hits[i].materialId], rays[i], hits[i], attenuation[i], scattered[i], samplers[i]);
+		break;
+	}
+}
+
+/// <summary>
+/// Flat list of the materials of a scene. Primitives and hits refer to a material by its index
+/// here, so tracing copies a 32 bit id instead of touching a shared_ptr refcount that every
+/// render thread contends on. Add() also snapshots each material into a MaterialRecord, edit a
+/// material before adding it.
+/// </summary>
+class MaterialTable
+{
+public:
+	uint32_t Add(shared_ptr<Material> mat)
+	{
+		materials.push_back(mat);
+		records.push_back(mat->Record());
+		return uint32_t(materials.size() - 1);
+	}
+	const Material& operator[](uint32_t id) const { return *materials[id]; }
+	const MaterialRecord& Record(uint32_t id) const { return records[id]; }
+	const MaterialRecord* Records() const { return records.data(); }
+	uint32_t Size() const { return uint32_t(materials.size()); }
+
+private:
+	std::vector<shared_ptr<Material>> materials;
+	std::vector<MaterialRecord> records;
 };
 
-#endif
\ No newline at end of file
+#endif
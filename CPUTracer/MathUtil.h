@@ -2,6 +2,8 @@
 #ifndef MATHUTIL_H
 #define MATHUTIL_H
 
+#include "Random.h"
+
 
 // Constants
 #define UTIL_CONST
@@ -19,9 +21,9 @@ inline double DegreesToRadians(double degrees) {
 /// <returns></returns>
 inline double RandomDouble()
 {
-    thread_local std::mt19937 generator(std::random_device{}());
-    thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
-    return dist(generator);
+    // Scene setup and tools only, rendering draws from an explicit Sampler
+    thread_local Pcg32 generator(std::random_device{}());
+    return generator.NextDouble();
 }
 inline double RandomDouble(double min, double max)
 {
@@ -0,0 +1,103 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include "RenderedObject.h"
+#include "Material.h"
+#include "RenderStats.h"
+
+#include <cmath>
+
+// Sky gradient a path picks up when it leaves the scene
+inline Vec3 Background(const Ray& r)
+{
+	Vec3 unitDirection = Normalize(r.Direction());
+	double a = 0.5 * (unitDirection.Y() + 1.0);
+	return (1.0 - a) * Vec3(1.0, 1.0, 1.0) + a * Vec3(0.5, 0.7, 1.0);
+}
+
+/// <summary>
+/// Russian roulette: the path goes on with probability equal to its brightest throughput channel
+/// (at most 1) and is scaled up by 1/p when it does, so the expected value is unchanged.
+/// Returns false when the path should end.
+/// </summary>
+inline bool SurviveRoulette(Vec3& throughput, Sampler& sampler)
+{
+	double p = std::fmin(std::fmax(throughput.X(), std::fmax(throughput.Y(), throughput.Z())), 1.0);
+	if (sampler.Next() >= p) return false;
+	throughput = throughput / p;
+	return true;
+}
+
+/// <summary>
+/// Radiance arriving along r, traced as a loop that carries the path throughput instead of
+/// recursing once per bounce. A path gets at most MaxDepth intersections and is black if it is
+/// still bouncing after them (MaxDepth 0 reads the limit from depthLimit at run time). From
+/// bounce rouletteDepth on, dim paths are ended early with Russian roulette. firstHit, when
+/// given, is where r already hit and skips the first intersection test. sampler must already be
+/// started on the camera sample, bounce n draws from sampler bounce n. rays is increased by the
+/// intersection tests the path makes.
+/// </summary>
+template<int MaxDepth>
+Vec3 TracePath(Ray r, const HitInfo* firstHit, const RenderedObject& scene, const MaterialTable& materials, int depthLimit, int rouletteDepth, Sampler& sampler, int& rays)
+{
+	const int maxDepth = MaxDepth > 0 ? MaxDepth : depthLimit;
+	Vec3 throughput(1, 1, 1);
+	HitInfo hit;
+
+	for (int depth = 0; depth < maxDepth; depth++)
+	{
+		if (depth == 0 && firstHit) hit = *firstHit;
+		else
+		{
+			rays++;
+			if (depth == 0) SPEEDTRACER_COUNT(primaryRays, 1);
+			else SPEEDTRACER_COUNT(secondaryRays, 1);
+			if (!scene.CheckHit(r, Interval(0.003, infinity), hit))
+			{
+				SPEEDTRACER_COUNT(escaped, 1);
+				return throughput * Background(r);
+			}
+			SPEEDTRACER_COUNT(hits, 1);
+		}
+
+		sampler.StartBounce(uint32_t(depth + 1));
+		Ray scattered;
+		Vec3 attenuation;
+		if (!Scatter(materials.Record(hit.materialId), r, hit, attenuation, scattered, sampler))
+		{
+			SPEEDTRACER_COUNT(absorbed, 1);
+			return Vec3(0, 0, 0);
+		}
+		throughput = throughput * attenuation;
+		r = scattered;
+
+		// No point rolling for a bounce that would end at the depth limit anyway
+		if (depth + 1 >= rouletteDepth && depth + 1 < maxDepth && !SurviveRoulette(throughput, sampler))
+		{
+			SPEEDTRACER_COUNT(rouletteKills, 1);
+			return Vec3(0, 0, 0);
+		}
+	}
+	SPEEDTRACER_COUNT(depthLimited, 1);
+	return Vec3(0, 0, 0);
+}
+
+typedef Vec3 (*PathTracerFunction)(Ray, const HitInfo*, const RenderedObject&, const MaterialTable&, int, int, Sampler&, int&);
+
+// Deepest bounce limit with its own TracePath instantiation
+const int maxUnrolledDepth = 16;
+
+/// <summary>
+/// TracePath instantiated for a bounce limit, picked once per render instead of per sample.
+/// Limits past maxUnrolledDepth use the run time loop.
+/// </summary>
+inline PathTracerFunction PathTracerFor(int maxDepth)
+{
+	static const PathTracerFunction table[maxUnrolledDepth + 1] = {
+		TracePath<0>, TracePath<1>, TracePath<2>, TracePath<3>, TracePath<4>, TracePath<5>, TracePath<6>, TracePath<7>, TracePath<8>,
+		TracePath<9>, TracePath<10>, TracePath<11>, TracePath<12>, TracePath<13>, TracePath<14>, TracePath<15>, TracePath<16>
+	};
+	return maxDepth >= 1 && maxDepth <= maxUnrolledDepth ? table[maxDepth] : table[0];
+}
+
+#endif
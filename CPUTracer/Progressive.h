@@ -0,0 +1,102 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "Utils.h"
+#include "Camera.h"
+#include "RenderedObject.h"
+#include "Material.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Renders on a background thread one sample per pixel at a time into a float accumulation
+/// buffer, the CPU side of the GPU's ping-pong accumulation. The estimate so far can be read at
+/// any time with Resolve(), and Stop() ends the run without waiting for the current pass.
+/// Pass n uses sample index n, so n finished passes give the same samples as Camera::Render()
+/// with n samples per pixel. A run can be started once; when it reaches maxPasses the image is
+/// saved to the camera's outputPath like Render() does.
+/// </summary>
+class ProgressiveRender
+{
+public:
+	// maxPasses 0 keeps adding samples until Stop()
+	ProgressiveRender(Camera& camera, RenderedObject& scene, const MaterialTable& materials, int maxPasses = 0)
+		: camera(camera), scene(scene), materials(materials), maxPasses(maxPasses),
+		accum(size_t(camera.imageWidth) * camera.imageHeight * 4, 0.0f) {}
+	~ProgressiveRender() { Stop(); }
+
+	ProgressiveRender(const ProgressiveRender&) = delete;
+	ProgressiveRender& operator=(const ProgressiveRender&) = delete;
+
+	void Start()
+	{
+		if (thread.joinable() || finished) return;
+		thread = std::thread([this]() { Run(); });
+	}
+	void Stop()
+	{
+		stopping = true;
+		if (thread.joinable()) thread.join();
+	}
+
+	// Passes that covered every pixel
+	int Passes() const { return passes.load(); }
+	// True once maxPasses passes are done or the run was stopped
+	bool Finished() const { return finished.load(); }
+
+	// Writes the current estimate as 8 bit RGB, black where a pixel has no samples yet
+	void Resolve(uint8_t* imageData) const
+	{
+		std::lock_guard<std::mutex> lock(accumLock);
+		for (int j = 0; j < camera.imageHeight; j++)
+		{
+			for (int i = 0; i < camera.imageWidth; i++)
+			{
+				const float* p = &accum[(size_t(j) * camera.imageWidth + i) * 4];
+				double scale = p[3] > 0 ? 1.0 / p[3] : 0.0;
+				WriteColor(imageData, Vec3(p[0] * scale, p[1] * scale, p[2] * scale), i, j, camera.imageWidth);
+			}
+		}
+	}
+	// Copy of the accumulation buffer: RGB sums and sample count per pixel
+	std::vector<float> Accumulation() const
+	{
+		std::lock_guard<std::mutex> lock(accumLock);
+		return accum;
+	}
+
+private:
+	Camera& camera;
+	RenderedObject& scene;
+	const MaterialTable& materials;
+	const int maxPasses;
+
+	std::vector<float> accum;
+	mutable std::mutex accumLock;
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+	std::atomic<bool> finished{ false };
+	std::atomic<int> passes{ 0 };
+
+	void Run()
+	{
+		for (int pass = passes; (maxPasses <= 0 || pass < maxPasses) && !stopping; pass++)
+		{
+			camera.RenderPass(scene, materials, accum.data(), accumLock, uint32_t(pass), stopping);
+			if (!stopping) passes = pass + 1;
+		}
+
+		if (maxPasses > 0 && passes == maxPasses && !camera.outputPath.empty())
+		{
+			std::vector<uint8_t> image(size_t(camera.imageWidth) * camera.imageHeight * 3);
+			Resolve(image.data());
+			WriteImage(camera.outputPath, camera.imageWidth, camera.imageHeight, image.data());
+		}
+		finished = true;
+	}
+};
+
+#endif
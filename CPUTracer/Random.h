@@ -0,0 +1,268 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "Simd.h"
+#include "BlueNoise.h"
+
+#include <cstdint>
+
+/// <summary>
+/// The PCG hash generator of NextRandom in GPUscreen.frag: a 32 bit LCG step (with the shader's
+/// frameCount term folded into the increment) and the RXS-M-XS output permutation. Four bytes
+/// of state instead of the 2.5 KB of std::mt19937.
+/// </summary>
+class Pcg32
+{
+public:
+	explicit Pcg32(uint32_t seed = 0, uint32_t frame = 0) : state(seed), increment(2891336453u + frame * 378173u) {}
+
+	uint32_t NextUInt()
+	{
+		state = state * 747796405u + increment;
+		return Permute(state);
+	}
+	// [0,1)
+	double NextDouble() { return NextUInt() * (1.0 / 4294967296.0); }
+
+	static uint32_t Permute(uint32_t state)
+	{
+		uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+		return (result >> 22) ^ result;
+	}
+
+private:
+	uint32_t state;
+	uint32_t increment;
+};
+
+/// <summary>
+/// simdWidth independent Pcg32 streams stepped together, one per lane.
+/// </summary>
+class Pcg32Wide
+{
+public:
+	explicit Pcg32Wide(uint32_t seed = 0, uint32_t frame = 0) : increment(2891336453u + frame * 378173u)
+	{
+		// Lane seeds run through the permutation so neighbouring seeds don't give similar streams
+		for (int lane = 0; lane < simdWidth; lane++) state[lane] = Pcg32::Permute(seed * uint32_t(simdWidth) + uint32_t(lane) + 1u);
+	}
+
+	// Writes simdWidth random values to out
+	void NextUInts(uint32_t* out)
+	{
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+		__m256i s = _mm256_load_si256((const __m256i*)state);
+		s = _mm256_add_epi32(_mm256_mullo_epi32(s, _mm256_set1_epi32(int(747796405u))), _mm256_set1_epi32(int(increment)));
+		_mm256_store_si256((__m256i*)state, s);
+
+		__m256i shift = _mm256_add_epi32(_mm256_srli_epi32(s, 28), _mm256_set1_epi32(4));
+		__m256i result = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_srlv_epi32(s, shift), s), _mm256_set1_epi32(int(277803737u)));
+		result = _mm256_xor_si256(_mm256_srli_epi32(result, 22), result);
+		_mm256_storeu_si256((__m256i*)out, result);
+#else
+		// SSE2 has neither a 32 bit multiply nor per lane shifts, a plain loop vectorizes as well as it can
+		for (int lane = 0; lane < simdWidth; lane++)
+		{
+			state[lane] = state[lane] * 747796405u + increment;
+			out[lane] = Pcg32::Permute(state[lane]);
+		}
+#endif
+	}
+	// Writes simdWidth floats in [0,1) to out
+	void NextFloats(float* out)
+	{
+		alignas(32) uint32_t bits[simdWidth];
+		NextUInts(bits);
+		// Top 24 bits so the float conversion is exact and never rounds up to 1
+		for (int lane = 0; lane < simdWidth; lane++) out[lane] = float(bits[lane] >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	alignas(32) uint32_t state[simdWidth];
+	uint32_t increment;
+};
+
+// Bit i of the result is bit 31-i of x
+inline uint32_t ReverseBits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+/// <summary>
+/// Owen scrambling as a hash (Burley 2020, "Practical Hash-based Owen Scrambling"): the
+/// Laine-Karras permutation only lets each bit depend on the bits below it, so running it on the
+/// reversed value flips every bit based on the bits above it, the same as a nested uniform
+/// scramble of a base 2 digit tree.
+/// </summary>
+inline uint32_t OwenScramble(uint32_t x, uint32_t seed)
+{
+	x = ReverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return ReverseBits(x);
+}
+
+// Sobol dimensions with direction numbers, samplers pad their dimensions in blocks of this many
+const int sobolDimensions = 4;
+
+/// <summary>
+/// The Sobol generator matrices of the first sobolDimensions dimensions (van der Corput, then the
+/// next three of Joe and Kuo's new-joe-kuo-6.21201), stored as the XOR of the direction numbers
+/// for every value of each index byte, so a point takes four lookups instead of a loop over bits.
+/// </summary>
+struct SobolTables
+{
+	uint32_t byteTerms[sobolDimensions][4][256];
+
+	SobolTables()
+	{
+		const int degree[sobolDimensions] = { 0, 1, 2, 3 };
+		const uint32_t coefficients[sobolDimensions] = { 0, 0, 1, 1 };
+		const uint32_t initial[sobolDimensions][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+		for (int d = 0; d < sobolDimensions; d++)
+		{
+			uint32_t v[32];
+			const int s = degree[d];
+			if (s == 0)
+				for (int k = 0; k < 32; k++) v[k] = 1u << (31 - k);
+			else
+			{
+				for (int k = 0; k < s; k++) v[k] = initial[d][k] << (31 - k);
+				for (int k = s; k < 32; k++)
+				{
+					uint32_t value = v[k - s] ^ (v[k - s] >> s);
+					for (int j = 1; j < s; j++)
+						if ((coefficients[d] >> (s - 1 - j)) & 1) value ^= v[k - j];
+					v[k] = value;
+				}
+			}
+
+			for (int byte = 0; byte < 4; byte++)
+			{
+				for (int value = 0; value < 256; value++)
+				{
+					uint32_t x = 0;
+					for (int bit = 0; bit < 8; bit++)
+						if ((value >> bit) & 1) x ^= v[byte * 8 + bit];
+					byteTerms[d][byte][value] = x;
+				}
+			}
+		}
+	}
+};
+
+// Point index of the Sobol sequence in dimension dim, as a 32 bit fraction
+inline uint32_t Sobol(uint32_t index, int dim)
+{
+	static const SobolTables tables;
+	const uint32_t (*terms)[256] = tables.byteTerms[dim];
+	return terms[0][index & 255] ^ terms[1][(index >> 8) & 255] ^ terms[2][(index >> 16) & 255] ^ terms[3][index >> 24];
+}
+
+enum class SamplerType
+{
+	Independent,	// Every value its own hash, plain Monte Carlo
+	Sobol,			// Owen scrambled Sobol points, scrambled differently in every pixel
+	BlueNoise		// One scrambled Sobol sequence for the whole image, shifted per pixel by a blue noise mask
+};
+
+/// <summary>
+/// Counter based random numbers: every value is a function of (seed, pixel, sample, bounce,
+/// dimension), so a sample comes out the same whichever thread renders it and in whatever order.
+/// Call StartSample for each camera sample and StartBounce before each bounce, Next then walks the
+/// dimensions of that bounce. The camera ray uses bounce 0.
+/// 
+/// SamplerType picks how the value is made. The low discrepancy types spread a pixel's samples
+/// evenly over each group of sobolDimensions dimensions of a bounce, so the pixel jitter (dims 0
+/// and 1 of bounce 0) and each bounce direction (dims 0 and 1) are stratified as a pair.
+/// </summary>
+class Sampler
+{
+public:
+	explicit Sampler(uint32_t seed = 0, SamplerType type = SamplerType::Independent) : seed(seed), type(type) { StartSample(0, 0, 0); }
+
+	void StartSample(int x, int y, uint32_t sampleIndex)
+	{
+		pixelX = x;
+		pixelY = y;
+		this->sampleIndex = sampleIndex;
+		pixelKey = Hash(seed ^ Hash(uint32_t(x) ^ Hash(uint32_t(y))));
+		samplePrefix = Hash(pixelKey ^ sampleIndex);
+		StartBounce(0);
+	}
+	void StartBounce(uint32_t bounce)
+	{
+		this->bounce = bounce;
+		bouncePrefix = Hash(samplePrefix ^ Hash(bounce));
+		dimension = 0;
+	}
+
+	// [0,1)
+	double Next()
+	{
+		uint32_t value;
+		switch (type)
+		{
+		case SamplerType::Sobol: value = NextSobol(); break;
+		case SamplerType::BlueNoise: value = NextBlueNoise(); break;
+		default: value = Hash(bouncePrefix ^ dimension); break;
+		}
+		dimension++;
+		return value * (1.0 / 4294967296.0);
+	}
+	double Next(double min, double max) { return min + Next() * (max - min); }
+
+	SamplerType Type() const { return type; }
+
+	// One PCG step followed by its output permutation, the pcg_hash of Jarzynski and Olano
+	static uint32_t Hash(uint32_t x) { return Pcg32::Permute(x * 747796405u + 2891336453u); }
+
+private:
+	uint32_t seed;
+	SamplerType type;
+	int pixelX, pixelY;
+	uint32_t sampleIndex;
+	uint32_t pixelKey;
+	uint32_t samplePrefix;
+	uint32_t bounce;
+	uint32_t bouncePrefix;
+	uint32_t dimension;
+
+	// Key of the sobolDimensions wide block the current dimension is in
+	uint32_t BlockKey(uint32_t base) const { return Hash(base ^ Hash((bounce << 8) + dimension / sobolDimensions)); }
+
+	uint32_t NextSobol() const
+	{
+		// Shuffling the point order per pixel and block keeps blocks from lining up with each other
+		uint32_t key = BlockKey(pixelKey);
+		uint32_t index = OwenScramble(sampleIndex, key);
+		uint32_t dim = dimension % sobolDimensions;
+		return OwenScramble(Sobol(index, int(dim)), Hash(key ^ (dim + 1)));
+	}
+	uint32_t NextBlueNoise() const
+	{
+		// The same points in every pixel, so neighbours differ only by their mask shift and the
+		// error is pushed to high frequencies. Each dimension reads the mask at its own offset.
+		uint32_t key = BlockKey(seed);
+		uint32_t index = OwenScramble(sampleIndex, key);
+		uint32_t dim = dimension % sobolDimensions;
+		uint32_t point = OwenScramble(Sobol(index, int(dim)), Hash(key ^ (dim + 1)));
+
+		uint32_t offset = Hash(key ^ (dim + 0x100u));
+		uint32_t x = (uint32_t(pixelX) + offset) & (blueNoiseSize - 1);
+		uint32_t y = (uint32_t(pixelY) + (offset >> 16)) & (blueNoiseSize - 1);
+		uint32_t rank = BlueNoiseMask()[y * blueNoiseSize + x];
+		// A toroidal shift by the pixel's rank, wrapping around 1 with the unsigned add
+		return point + rank * (0xffffffffu / uint32_t(blueNoiseSize * blueNoiseSize));
+	}
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "Ray.h"
+#include "AABB.h"
+#include "Interval.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <cstdint>
+
+/// <summary>
+/// Planes through a shared ray origin that enclose every ray of a packet.
+/// Inside means Dot(normal, p - origin) >= 0 for all planes.
+/// </summary>
+class Frustum
+{
+public:
+	Vec3 origin;
+	Vec3 normals[5];
+	int planeCount = 0;
+
+	bool Culls(const AABB& box) const
+	{
+		for (int i = 0; i < planeCount; i++)
+		{
+			// Corner of the box furthest along the plane normal
+			const Vec3& n = normals[i];
+			Vec3 corner(n.X() >= 0 ? box.max.X() : box.min.X(), n.Y() >= 0 ? box.max.Y() : box.min.Y(), n.Z() >= 0 ? box.max.Z() : box.min.Z());
+			if (Dot(n, corner - origin) < 0) return true;
+		}
+		return false;
+	}
+};
+
+/// <summary>
+/// Up to 64 coherent rays traced together. Rays are kept in double for the primitive tests and
+/// as float structure of arrays so box tests run across rays in SIMD lanes.
+/// </summary>
+class RayPacket
+{
+public:
+	static const int maxSize = 64;
+
+	int size = 0;
+	Ray rays[maxSize];
+	double tMin = 0;
+	double tMax[maxSize];
+	Frustum frustum;
+	bool hasFrustum = false;
+
+	alignas(cacheLineSize) float originX[maxSize];
+	alignas(cacheLineSize) float originY[maxSize];
+	alignas(cacheLineSize) float originZ[maxSize];
+	alignas(cacheLineSize) float invDirX[maxSize];
+	alignas(cacheLineSize) float invDirY[maxSize];
+	alignas(cacheLineSize) float invDirZ[maxSize];
+	alignas(cacheLineSize) float tMaxF[maxSize];
+
+	void Clear() { size = 0; }
+	void Add(const Ray& r) { rays[size++] = r; }
+
+	uint64_t AllRays() const
+	{
+		return size == 64 ? ~uint64_t(0) : (uint64_t(1) << size) - 1;
+	}
+
+	/// <summary>
+	/// Fills the float lanes and builds the frustum. Call once after adding the rays.
+	/// </summary>
+	void Finalize(Interval rayT)
+	{
+		tMin = rayT.min;
+		tMinF = float(rayT.min);
+		for (int i = 0; i < size; i++)
+		{
+			originX[i] = float(rays[i].Origin().X());
+			originY[i] = float(rays[i].Origin().Y());
+			originZ[i] = float(rays[i].Origin().Z());
+			invDirX[i] = float(1.0 / rays[i].Direction().X());
+			invDirY[i] = float(1.0 / rays[i].Direction().Y());
+			invDirZ[i] = float(1.0 / rays[i].Direction().Z());
+			tMax[i] = rayT.max;
+			tMaxF[i] = float(rayT.max);
+		}
+		// Padding lanes up to the SIMD width never hit anything
+		for (int i = size; i < (size + simdWidth - 1) / simdWidth * simdWidth; i++)
+		{
+			originX[i] = originY[i] = originZ[i] = 0;
+			invDirX[i] = invDirY[i] = invDirZ[i] = 1;
+			tMaxF[i] = float(-infinity);
+		}
+		BuildFrustum();
+	}
+	void SetHit(int i, double t)
+	{
+		tMax[i] = t;
+		tMaxF[i] = float(t);
+	}
+
+	/// <summary>
+	/// Slab tests the active rays against one box. Returns the subset of active that hit it.
+	/// </summary>
+	uint64_t IntersectBox(const AABB& box, uint64_t active) const
+	{
+		float minX = std::nextafter(float(box.min.X()), -HUGE_VALF);
+		float minY = std::nextafter(float(box.min.Y()), -HUGE_VALF);
+		float minZ = std::nextafter(float(box.min.Z()), -HUGE_VALF);
+		float maxX = std::nextafter(float(box.max.X()), HUGE_VALF);
+		float maxY = std::nextafter(float(box.max.Y()), HUGE_VALF);
+		float maxZ = std::nextafter(float(box.max.Z()), HUGE_VALF);
+
+		uint64_t result = 0;
+		for (int first = 0; first < size; first += simdWidth)
+		{
+			if (!((active >> first) & ((uint64_t(1) << simdWidth) - 1))) continue;
+			uint64_t mask = IntersectLanes(first, minX, minY, minZ, maxX, maxY, maxZ);
+			result |= mask << first;
+		}
+		return result & active;
+	}
+
+private:
+	// Same far distance widening as the wide BVH, float boxes must not reject double hits
+	static constexpr float farScale = 1.0000004f;
+	float tMinF = 0;
+
+	void BuildFrustum()
+	{
+		hasFrustum = false;
+		if (size == 0) return;
+
+		const Vec3& origin = rays[0].Origin();
+		Vec3 sum;
+		for (int i = 0; i < size; i++)
+		{
+			const Vec3& o = rays[i].Origin();
+			if (o.X() != origin.X() || o.Y() != origin.Y() || o.Z() != origin.Z()) return;
+			sum += Normalize(rays[i].Direction());
+		}
+
+		// Bound the slopes of every ray along the dominant axis of the packet
+		int k = std::fabs(sum.X()) > std::fabs(sum.Y()) ? (std::fabs(sum.X()) > std::fabs(sum.Z()) ? 0 : 2) : (std::fabs(sum.Y()) > std::fabs(sum.Z()) ? 1 : 2);
+		int u = (k + 1) % 3;
+		int v = (k + 2) % 3;
+		double s = sum[k] > 0 ? 1.0 : -1.0;
+		double uMin = infinity, uMax = -infinity, vMin = infinity, vMax = -infinity;
+		for (int i = 0; i < size; i++)
+		{
+			const Vec3& d = rays[i].Direction();
+			if (d[k] * s <= 0) return;
+			uMin = std::fmin(uMin, d[u] / d[k]);
+			uMax = std::fmax(uMax, d[u] / d[k]);
+			vMin = std::fmin(vMin, d[v] / d[k]);
+			vMax = std::fmax(vMax, d[v] / d[k]);
+		}
+
+		Vec3 axisK, axisU, axisV;
+		axisK[k] = 1;
+		axisU[u] = 1;
+		axisV[v] = 1;
+		frustum.origin = origin;
+		frustum.normals[0] = s * (axisU - uMin * axisK);
+		frustum.normals[1] = s * (uMax * axisK - axisU);
+		frustum.normals[2] = s * (axisV - vMin * axisK);
+		frustum.normals[3] = s * (vMax * axisK - axisV);
+		frustum.normals[4] = s * axisK;
+		frustum.planeCount = 5;
+		hasFrustum = true;
+	}
+
+	uint64_t IntersectLanes(int first, float minX, float minY, float minZ, float maxX, float maxY, float maxZ) const
+	{
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+		__m256 ox = _mm256_load_ps(&originX[first]);
+		__m256 oy = _mm256_load_ps(&originY[first]);
+		__m256 oz = _mm256_load_ps(&originZ[first]);
+		__m256 ix = _mm256_load_ps(&invDirX[first]);
+		__m256 iy = _mm256_load_ps(&invDirY[first]);
+		__m256 iz = _mm256_load_ps(&invDirZ[first]);
+
+		__m256 ax = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minX), ox), ix);
+		__m256 bx = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxX), ox), ix);
+		__m256 ay = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minY), oy), iy);
+		__m256 by = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxY), oy), iy);
+		__m256 az = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minZ), oz), iz);
+		__m256 bz = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxZ), oz), iz);
+
+		__m256 t0 = _mm256_max_ps(_mm256_min_ps(ax, bx), _mm256_max_ps(_mm256_min_ps(ay, by), _mm256_max_ps(_mm256_min_ps(az, bz), _mm256_set1_ps(tMinF))));
+		__m256 t1 = _mm256_min_ps(_mm256_max_ps(ax, bx), _mm256_min_ps(_mm256_max_ps(ay, by), _mm256_min_ps(_mm256_max_ps(az, bz), _mm256_load_ps(&tMaxF[first]))));
+		t1 = _mm256_mul_ps(t1, _mm256_set1_ps(farScale));
+		return uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+		__m128 ox = _mm_load_ps(&originX[first]);
+		__m128 oy = _mm_load_ps(&originY[first]);
+		__m128 oz = _mm_load_ps(&originZ[first]);
+		__m128 ix = _mm_load_ps(&invDirX[first]);
+		__m128 iy = _mm_load_ps(&invDirY[first]);
+		__m128 iz = _mm_load_ps(&invDirZ[first]);
+
+		__m128 ax = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minX), ox), ix);
+		__m128 bx = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxX), ox), ix);
+		__m128 ay = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minY), oy), iy);
+		__m128 by = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxY), oy), iy);
+		__m128 az = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minZ), oz), iz);
+		__m128 bz = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxZ), oz), iz);
+
+		__m128 t0 = _mm_max_ps(_mm_min_ps(ax, bx), _mm_max_ps(_mm_min_ps(ay, by), _mm_max_ps(_mm_min_ps(az, bz), _mm_set1_ps(tMinF))));
+		__m128 t1 = _mm_min_ps(_mm_max_ps(ax, bx), _mm_min_ps(_mm_max_ps(ay, by), _mm_min_ps(_mm_max_ps(az, bz), _mm_load_ps(&tMaxF[first]))));
+		t1 = _mm_mul_ps(t1, _mm_set1_ps(farScale));
+		return uint64_t(_mm_movemask_ps(_mm_cmple_ps(t0, t1)));
+#else
+		uint64_t mask = 0;
+		for (int lane = 0; lane < simdWidth; lane++)
+		{
+			int i = first + lane;
+			float ax = (minX - originX[i]) * invDirX[i], bx = (maxX - originX[i]) * invDirX[i];
+			float ay = (minY - originY[i]) * invDirY[i], by = (maxY - originY[i]) * invDirY[i];
+			float az = (minZ - originZ[i]) * invDirZ[i], bz = (maxZ - originZ[i]) * invDirZ[i];
+			float t0 = std::fmax(std::fmin(ax, bx), std::fmax(std::fmin(ay, by), std::fmax(std::fmin(az, bz), tMinF)));
+			float t1 = std::fmin(std::fmax(ax, bx), std::fmin(std::fmax(ay, by), std::fmin(std::fmax(az, bz), tMaxF[i])));
+			if (t0 <= t1 * farScale) mask |= uint64_t(1) << lane;
+		}
+		return mask;
+#endif
+	}
+};
+
+#endif
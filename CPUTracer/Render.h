@@ -4,11 +4,15 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
+#include <deque>
 #include <filesystem>
+#include <vector>
 
 #include "Utils.h"
 #include "shaderClass.h"
 #include "Text.h"
+#include "Progressive.h"
+#include "Trace.h"
 
 static void CheckError()
 {
@@ -16,6 +20,93 @@ static void CheckError()
 	while ((err = glGetError()) != GL_NO_ERROR)
 		std::cerr << "GL Error: " << std::hex << err << std::endl;
 }
+/// <summary>
+/// How long the GPU spent on each tracer pass, from GL_TIMESTAMP queries put around the pass.
+/// Results are read a few frames later once the GPU has them, so the CPU never waits, and land
+/// on the GPU track of the global trace. Does nothing while the tracer is off.
+/// </summary>
+class GpuPassTimer
+{
+public:
+	~GpuPassTimer()
+	{
+		if (!queries.empty()) glDeleteQueries(GLsizei(queries.size()), queries.data());
+	}
+	void Begin()
+	{
+		active = GlobalTracer().Enabled();
+		if (!active) return;
+		if (!synced)
+		{
+			// GPU timestamps count from an unrelated origin, line them up with the trace clock once
+			GLint64 gpuNow = 0;
+			glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+			offset = GlobalTracer().Now() - gpuNow;
+			GlobalTracer().NameTrack(Tracer::gpuTrack, "GPU");
+			synced = true;
+		}
+		current.begin = Query();
+		glQueryCounter(current.begin, GL_TIMESTAMP);
+	}
+	void End(const char* name, int pass)
+	{
+		if (!active) return;
+		current.end = Query();
+		glQueryCounter(current.end, GL_TIMESTAMP);
+		current.name = name;
+		current.pass = pass;
+		pending.push_back(current);
+	}
+	// Records every pass whose timestamps have arrived, call once a frame
+	void Collect()
+	{
+		while (!pending.empty())
+		{
+			const Pass& pass = pending.front();
+			GLint available = 0;
+			glGetQueryObjectiv(pass.end, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(pass.begin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(pass.end, GL_QUERY_RESULT, &end);
+			GlobalTracer().Record(pass.name, "gpu", (long long)begin + offset, (long long)end + offset, Tracer::Args{ { "pass", nullptr }, { pass.pass, 0 } },
+				Tracer::gpuTrack);
+			spare.push_back(pass.begin);
+			spare.push_back(pass.end);
+			pending.pop_front();
+		}
+	}
+
+private:
+	struct Pass
+	{
+		GLuint begin, end;
+		const char* name;
+		int pass;
+	};
+	std::vector<GLuint> queries;
+	std::vector<GLuint> spare;
+	std::deque<Pass> pending;
+	Pass current = {};
+	long long offset = 0;
+	bool synced = false;
+	bool active = false;
+
+	GLuint Query()
+	{
+		if (spare.empty())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			queries.push_back(query);
+			return query;
+		}
+		GLuint query = spare.back();
+		spare.pop_back();
+		return query;
+	}
+};
+
 static void SetupQuad(uint8_t* imageData, Vec3 windowSize, unsigned int* textureID, unsigned int* VAO)
 {
 	float vertices[] = {
@@ -66,7 +157,8 @@ static void SetupQuad(uint8_t* imageData, Vec3 windowSize, unsigned int* texture
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
-static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData, Shader gpuShader, Scene scene, bool rotate)
+// progressive, when given, keeps updating imageData and the CPU mode texture as its passes finish
+static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData, Shader gpuShader, Scene scene, bool rotate, ProgressiveRender* progressive = nullptr)
 {
 	if (windowSize.X() <= 0 || windowSize.Y() <= 0 || imageData == nullptr)
 	{
@@ -93,6 +185,7 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 	int frameCounter = 0;
 	int globalFrameCount = 0;
 	std::string FPS = "";
+	float previousUploadTime = 0;
 
 	glfwSwapInterval(0);
 
@@ -124,9 +217,13 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 	bool resetAccum = false;
 
 	Shader displayShader("GPUTracer/display.vert", "GPUTracer/display.frag");
+	GpuPassTimer gpuTimer;
+	GlobalTracer().NameThread("main");
 
 	while (!glfwWindowShouldClose(window)) {
 		globalFrameCount++;
+		TraceScope frameTrace("frame", "gpu", "frame", globalFrameCount);
+		gpuTimer.Collect();
 		glfwPollEvents();
 		if (glfwGetMouseButton(window, 0))
 		{
@@ -150,7 +247,9 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 		float changeInTime = glfwGetTime() - previousFPSGroupTime;
 		if (changeInTime > 0.35f)
 		{
-			FPS = GPUMode ? std::to_string((1.0 / changeInTime) * frameCounter) : "Pre-Rendered";
+			if (GPUMode) FPS = std::to_string((1.0 / changeInTime) * frameCounter);
+			else if (progressive) FPS = "CPU pass " + std::to_string(progressive->Passes()) + (progressive->Finished() ? " (done)" : "");
+			else FPS = "Pre-Rendered";
 			frameCounter = 0;
 			previousFPSGroupTime = glfwGetTime();
 		}
@@ -171,6 +270,8 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 			int framgeGenItterations = rotate ? 20 : 1;
 			for (int i = 0; i < framgeGenItterations; i++)
 			{
+				TraceScope passTrace("submit pass", "gpu", "pass", i);
+				gpuTimer.Begin();
 				glBindFramebuffer(GL_FRAMEBUFFER, currentFBO);
 				glViewport(0, 0, windowSize.X(), windowSize.Y());
 
@@ -204,12 +305,23 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 				glUniform1i(glGetUniformLocation(displayShader.ID, "screenTexture"), 0);
 				glBindVertexArray(VAO);
 				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				gpuTimer.End("tracer pass", i);
 
 				accumulationFrame++;
 			}
 		}
 		else
 		{
+			// Tiles land in the accumulation buffer all the time, a few uploads a second is enough
+			if (progressive && glfwGetTime() - previousUploadTime > 0.25f)
+			{
+				TraceScope trace("texture upload", "gpu");
+				progressive->Resolve(imageData);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowSize.X(), windowSize.Y(), GL_RGB, GL_UNSIGNED_BYTE, imageData);
+				glGenerateMipmap(GL_TEXTURE_2D);
+				previousUploadTime = glfwGetTime();
+			}
+
 			cpuShader.Activate();
 			int loc = glGetUniformLocation(cpuShader.ID, "screenTexture");
 			glUniform1i(glGetUniformLocation(cpuShader.ID, "screenTexture"), 0); // Set texture uniform
@@ -221,9 +333,13 @@ static void RenderQuad(Vec3 windowSize, GLFWwindow* window, uint8_t* imageData,
 		
 		
 		Text::RenderText(textShader, "FPS: " + FPS, windowSize.X() / 8, windowSize.Y() / 8, 0.5f, LEFT_ALIGN, glm::vec3(1.0f));
-		glfwSwapBuffers(window);
+		{
+			TraceScope trace("swap buffers", "gpu");
+			glfwSwapBuffers(window);
+		}
 		glfwPollEvents();
 	}
+	if (progressive) progressive->Stop();
 	free(imageData);
 	// Delete window before ending the program
 	glfwDestroyWindow(window);
@@ -0,0 +1,204 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include "Simd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Define SPEEDTRACER_COUNTERS as 1 to compile in the RayCounters hooks. Off they are empty macros
+#ifndef SPEEDTRACER_COUNTERS
+#define SPEEDTRACER_COUNTERS 0
+#endif
+
+/// <summary>
+/// Detailed counts from inside the path loops and the intersection routines. Every render worker
+/// counts into its own copy through ThreadCounters(), aligned to a cache line so no two workers
+/// ever write the same line. primitiveTests counts ray/sphere tests, so with an acceleration
+/// structure it is the work its traversal left over. A path ends by escaping to the sky, being
+/// absorbed (an emitter or a scatter below the surface), losing at Russian roulette, or running
+/// into the depth limit.
+/// </summary>
+struct alignas(cacheLineSize) RayCounters
+{
+	long long primaryRays = 0;
+	long long secondaryRays = 0;
+	long long primitiveTests = 0;
+	long long hits = 0;
+	long long escaped = 0;
+	long long absorbed = 0;
+	long long rouletteKills = 0;
+	long long depthLimited = 0;
+
+	RayCounters& operator+=(const RayCounters& other)
+	{
+		primaryRays += other.primaryRays;
+		secondaryRays += other.secondaryRays;
+		primitiveTests += other.primitiveTests;
+		hits += other.hits;
+		escaped += other.escaped;
+		absorbed += other.absorbed;
+		rouletteKills += other.rouletteKills;
+		depthLimited += other.depthLimited;
+		return *this;
+	}
+
+	std::string Json() const
+	{
+		return "{ \"primaryRays\": " + std::to_string(primaryRays) + ", \"secondaryRays\": " + std::to_string(secondaryRays) +
+			", \"primitiveTests\": " + std::to_string(primitiveTests) + ", \"hits\": " + std::to_string(hits) + ", \"escaped\": " + std::to_string(escaped) +
+			", \"absorbed\": " + std::to_string(absorbed) + ", \"rouletteKills\": " + std::to_string(rouletteKills) +
+			", \"depthLimited\": " + std::to_string(depthLimited) + " }";
+	}
+};
+
+#if SPEEDTRACER_COUNTERS
+// The counters of the render worker on this thread, null when the thread isn't rendering
+inline RayCounters*& ThreadCounters()
+{
+	static thread_local RayCounters* counters = nullptr;
+	return counters;
+}
+#define SPEEDTRACER_COUNT(field, n) do { if (RayCounters* counters_ = ThreadCounters()) counters_->field += (n); } while (0)
+#else
+#define SPEEDTRACER_COUNT(field, n) ((void)0)
+#endif
+
+/// <summary>
+/// What the last Camera::Render() traced. raysPerBounce[0] is the primary rays, [n] the rays of
+/// bounce n; rays is their sum. pathLengths[n] is the samples whose path made n intersection
+/// tests, counted by the path loop integrators. seconds covers the tile pass only, not denoising
+/// or saving. workerSeconds and workerSamples hold each worker's share, far apart values mean the
+/// tiles were uneven. counters is only filled in builds with SPEEDTRACER_COUNTERS.
+/// </summary>
+struct RenderStats
+{
+	double seconds = 0;
+	long long samples = 0;
+	long long rays = 0;
+	std::vector<long long> raysPerBounce;
+	std::vector<long long> pathLengths;
+	std::vector<double> workerSeconds;
+	std::vector<long long> workerSamples;
+	RayCounters counters;
+
+	double RaysPerSecond() const { return seconds > 0 ? rays / seconds : 0.0; }
+	double SamplesPerSecond() const { return seconds > 0 ? samples / seconds : 0.0; }
+
+	// Busiest worker's time over the mean, 1 is a perfectly even split
+	double Imbalance() const
+	{
+		if (workerSeconds.empty()) return 1.0;
+		double total = 0, longest = 0;
+		for (double s : workerSeconds)
+		{
+			total += s;
+			longest = std::max(longest, s);
+		}
+		return total > 0 ? longest * workerSeconds.size() / total : 1.0;
+	}
+
+	void Print(FILE* out) const
+	{
+		fprintf(out, "%.3f s, %lld samples, %lld rays, %.2f Mrays/s\n", seconds, samples, rays, RaysPerSecond() / 1e6);
+		fprintf(out, "rays per bounce:");
+		for (long long count : raysPerBounce) fprintf(out, " %lld", count);
+		fprintf(out, "\npaths by length:");
+		for (long long count : pathLengths) fprintf(out, " %lld", count);
+		fprintf(out, "\nworkers: %d, imbalance %.2f, seconds:", int(workerSeconds.size()), Imbalance());
+		for (double s : workerSeconds) fprintf(out, " %.3f", s);
+		fprintf(out, "\n");
+#if SPEEDTRACER_COUNTERS
+		const RayCounters& c = counters;
+		fprintf(out, "primary rays %lld, secondary rays %lld, primitive tests %lld (%.1f per ray), hits %lld, escaped %lld\n", c.primaryRays,
+			c.secondaryRays, c.primitiveTests, double(c.primitiveTests) / std::max(1LL, c.primaryRays + c.secondaryRays), c.hits, c.escaped);
+		fprintf(out, "paths ended: escaped %lld, absorbed %lld, roulette %lld, depth limit %lld\n", c.escaped, c.absorbed, c.rouletteKills, c.depthLimited);
+#endif
+	}
+
+	// The stats as a JSON object
+	std::string Json() const
+	{
+		char number[64];
+		auto list = [&](const char* name, const std::vector<long long>& values)
+		{
+			std::string out = std::string("\"") + name + "\": [";
+			for (size_t i = 0; i < values.size(); i++) out += (i ? ", " : "") + std::to_string(values[i]);
+			return out + "]";
+		};
+		snprintf(number, sizeof(number), "%.6f", seconds);
+		std::string json = std::string("{ \"seconds\": ") + number + ", \"samples\": " + std::to_string(samples) + ", \"rays\": " + std::to_string(rays) + ", ";
+		json += list("raysPerBounce", raysPerBounce) + ", " + list("pathLengths", pathLengths) + ", \"workerSeconds\": [";
+		for (size_t i = 0; i < workerSeconds.size(); i++)
+		{
+			snprintf(number, sizeof(number), "%s%.6f", i ? ", " : "", workerSeconds[i]);
+			json += number;
+		}
+		json += "], " + list("workerSamples", workerSamples);
+#if SPEEDTRACER_COUNTERS
+		json += ", \"counters\": " + counters.Json();
+#endif
+		return json + " }";
+	}
+};
+
+/// <summary>
+/// Counts one render worker keeps to itself and hands over when it runs out of tiles. The path
+/// loops only know how many intersection tests a whole path made, so they count paths by length;
+/// the wavefront integrator sees each bounce and counts rays per bounce directly.
+/// </summary>
+struct WorkerStats
+{
+	RayCounters counters;
+	double seconds = 0;
+	long long samples = 0;
+	std::vector<long long> pathLengths;	// [n] is the samples whose path made n intersection tests
+	std::vector<long long> bounceRays;
+
+	void Reset(int maxDepth)
+	{
+		counters = RayCounters();
+		seconds = 0;
+		samples = 0;
+		pathLengths.assign(std::max(0, maxDepth) + 1, 0);
+		bounceRays.assign(std::max(0, maxDepth), 0);
+	}
+	void CountPath(int rays)
+	{
+		samples++;
+		pathLengths[std::min(rays, int(pathLengths.size()) - 1)]++;
+	}
+};
+
+// Adds the counts of every worker into stats, which keeps its seconds
+inline void MergeStats(const AlignedVector<WorkerStats>& workers, RenderStats& stats)
+{
+	stats.samples = 0;
+	stats.rays = 0;
+	stats.raysPerBounce.clear();
+	stats.pathLengths.clear();
+	stats.workerSeconds.clear();
+	stats.workerSamples.clear();
+	stats.counters = RayCounters();
+	for (const WorkerStats& worker : workers)
+	{
+		stats.samples += worker.samples;
+		stats.workerSeconds.push_back(worker.seconds);
+		stats.workerSamples.push_back(worker.samples);
+		stats.counters += worker.counters;
+		stats.pathLengths.resize(std::max(stats.pathLengths.size(), worker.pathLengths.size()), 0);
+		for (size_t n = 0; n < worker.pathLengths.size(); n++) stats.pathLengths[n] += worker.pathLengths[n];
+		stats.raysPerBounce.resize(std::max(stats.raysPerBounce.size(), worker.bounceRays.size()), 0);
+		for (size_t b = 0; b < worker.bounceRays.size(); b++) stats.raysPerBounce[b] += worker.bounceRays[b];
+		// A path of n tests traced one ray at each of the bounces 0 to n - 1
+		for (size_t n = 1; n < worker.pathLengths.size(); n++)
+			for (size_t b = 0; b < n; b++) stats.raysPerBounce[b] += worker.pathLengths[n];
+	}
+	for (long long count : stats.raysPerBounce) stats.rays += count;
+	// The wavefront integrator doesn't follow whole paths, leave the lengths out rather than report zeros
+	if (std::all_of(stats.pathLengths.begin(), stats.pathLengths.end(), [](long long count) { return count == 0; })) stats.pathLengths.clear();
+}
+
+#endif
@@ -4,8 +4,10 @@
 #include "Vec3.h"
 #include "Ray.h"
 #include "Interval.h"
+#include "AABB.h"
+#include "RayPacket.h"
 
-class Material;
+#include <cstdint>
 
 class HitInfo
 {
@@ -14,7 +16,7 @@ public:
 	Vec3 normal;
 	double t;
 	bool frontFace;
-	shared_ptr<Material> mat;
+	uint32_t materialId;	// Index into the scene's MaterialTable
 
 	/// <summary>
 	/// 
@@ -33,5 +35,43 @@ public:
 	virtual ~RenderedObject() = default;
 
 	virtual bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const = 0;
+	virtual AABB BoundingBox() const = 0;
+
+	/// <summary>
+	/// Traces every ray of a finalized packet. Returns a bitmask of the rays that hit something
+	/// and fills hits[i] for each of them. The default tests the rays one at a time.
+	/// </summary>
+	virtual uint64_t CheckHitPacket(RayPacket& packet, HitInfo hits[]) const
+	{
+		uint64_t hitMask = 0;
+		for (int i = 0; i < packet.size; i++)
+		{
+			if (CheckHit(packet.rays[i], Interval(packet.tMin, packet.tMax[i]), hits[i]))
+			{
+				hitMask |= uint64_t(1) << i;
+				packet.SetHit(i, hits[i].t);
+			}
+		}
+		return hitMask;
+	}
+
+protected:
+	/// <summary>
+	/// Tests the active rays of a packet against one object, keeping the closest hit of each ray.
+	/// </summary>
+	static uint64_t CheckHitActive(const RenderedObject& object, RayPacket& packet, uint64_t active, HitInfo hits[])
+	{
+		uint64_t hitMask = 0;
+		for (int i = 0; i < packet.size; i++)
+		{
+			if (!((active >> i) & 1)) continue;
+			if (object.CheckHit(packet.rays[i], Interval(packet.tMin, packet.tMax[i]), hits[i]))
+			{
+				hitMask |= uint64_t(1) << i;
+				packet.SetHit(i, hits[i].t);
+			}
+		}
+		return hitMask;
+	}
 };
 #endif
\ No newline at end of file
@@ -1,23 +1,29 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+// SPEEDTRACER_HEADLESS leaves out the OpenGL upload so the CPU tracer builds without GL, GLFW or glm
+#ifndef SPEEDTRACER_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #include "RenderedObject.h"
 #include "MathUtil.h"
 #include "Vec3.h"
 #include "Sphere.h"
+#include "SphereSoA.h"
 #include "Material.h"
+#include "Trace.h"
 
+#include <memory>
+#include <vector>
+
+#ifndef SPEEDTRACER_HEADLESS
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <memory>
-#include <vector>
-
 #include "shaderClass.h"
 
 using std::make_shared;
@@ -39,6 +45,7 @@ struct GSphere
 	float radius;
 	GMaterial mat;
 };
+#endif
 class Scene : public RenderedObject
 {
 public:
@@ -47,16 +54,40 @@ public:
 	Vec3 backgroundBottomColor;
 	Vec3 cameraPos;
 	Vec3 cameraRot;
+	// Materials the objects refer to by index
+	MaterialTable materials;
 
 	Scene() {}
 	Scene(shared_ptr<RenderedObject> object) { Add(object); }
 
-	void Clear() { objects.clear(); }
+	// Packed copy of objects used by CheckHit, see PackSpheres()
+	shared_ptr<SphereSoA> sphereStore;
 
-	void Add(shared_ptr<RenderedObject> object) { objects.push_back(object); }
+	void Clear() { objects.clear(); sphereStore.reset(); }
+
+	uint32_t AddMaterial(shared_ptr<Material> mat) { return materials.Add(mat); }
+
+	void Add(shared_ptr<RenderedObject> object) { objects.push_back(object); sphereStore.reset(); }
+
+	/// <summary>
+	/// Swaps the object loop for a SphereSoA when every object is a Sphere.
+	/// Returns false and leaves the scene unpacked otherwise. Call again after editing objects directly.
+	/// </summary>
+	bool PackSpheres()
+	{
+		sphereStore.reset();
+		for (const auto& object : objects)
+		{
+			if (!dynamic_cast<Sphere*>(object.get())) return false;
+		}
+		sphereStore = make_shared<SphereSoA>(objects);
+		return true;
+	}
 
 	bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const override
 	{
+		if (sphereStore) return sphereStore->CheckHit(r, rayT, hit);
+
 		HitInfo tempHit;
 		bool hasHit = false;
 		double closestSoFar = rayT.max;
@@ -72,6 +103,26 @@ public:
 		}
 		return hasHit;
 	}
+	uint64_t CheckHitPacket(RayPacket& packet, HitInfo hits[]) const override
+	{
+		if (sphereStore) return sphereStore->CheckHitPacket(packet, hits);
+
+		uint64_t hitMask = 0;
+		uint64_t all = packet.AllRays();
+		for (const auto& object : objects)
+		{
+			if (packet.hasFrustum && packet.frustum.Culls(object->BoundingBox())) continue;
+			hitMask |= CheckHitActive(*object, packet, all, hits);
+		}
+		return hitMask;
+	}
+	AABB BoundingBox() const override
+	{
+		AABB bounds;
+		for (const auto& object : objects) bounds.Expand(object->BoundingBox());
+		return bounds;
+	}
+#ifndef SPEEDTRACER_HEADLESS
 	void CreateBuffer(Shader screenShader, Vec3 windowSize)
 	{
 		glGenBuffers(1, &sceneBuffer);
@@ -83,24 +134,26 @@ public:
 	}
 	void UpdateBuffer(Shader screenShader, int frameCount, Vec3 screenSize)
 	{
+		TraceScope trace("scene upload", "gpu", "objects", (long long)objects.size());
 		std::vector<GSphere> spheres;
 		for (size_t i = 0; i < objects.size(); i++)
 		{
 			if (Sphere* sphere = dynamic_cast<Sphere*>(objects[i].get()))
 			{
+				const Material* mat = &materials[sphere->materialId];
 				glm::vec4 color(1.0);
 				glm::vec4 emmision(0.0);
 				float smoothness = 0.0;
-				if (Lambertian* lambert = dynamic_cast<Lambertian*>(sphere->mat.get()))
+				if (const Lambertian* lambert = dynamic_cast<const Lambertian*>(mat))
 				{
 					color = glm::vec4(lambert->albedo.X(), lambert->albedo.Y(), lambert->albedo.Z(), 1.0);
 				}
-				if (Metal* lambert = dynamic_cast<Metal*>(sphere->mat.get()))
+				if (const Metal* lambert = dynamic_cast<const Metal*>(mat))
 				{
 					color = glm::vec4(lambert->albedo.X(), lambert->albedo.Y(), lambert->albedo.Z(), 1.0);
 					smoothness = 0.7;
 				}
-				if (Emmisive* lambert = dynamic_cast<Emmisive*>(sphere->mat.get()))
+				if (const Emmisive* lambert = dynamic_cast<const Emmisive*>(mat))
 				{
 					color = glm::vec4(lambert->albedo.X(), lambert->albedo.Y(), lambert->albedo.Z(), 1.0);
 					emmision = glm::vec4(lambert->emmision.X(), lambert->emmision.Y(), lambert->emmision.Z(), 1.0);
@@ -146,5 +199,6 @@ public:
 	}
 private:
 	GLuint sceneBuffer;
+#endif
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "Utils.h"
+#include "Camera.h"
+#include "EncodeQueue.h"
+#include "RenderedObject.h"
+#include "Material.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+/// <summary>
+/// Where the camera is for one frame, rotation in Euler degrees like Scene::cameraRot
+/// </summary>
+struct CameraPose
+{
+	Vec3 position;
+	Vec3 rotation;
+};
+
+/// <summary>
+/// The rotation (pitch about X, then yaw about Y) that turns the camera at from to face to
+/// </summary>
+inline Vec3 LookAtRotation(const Vec3& from, const Vec3& to)
+{
+	Vec3 d = Normalize(to - from);
+	double pitch = asin(std::fmax(-1.0, std::fmin(1.0, d.Y())));
+	double yaw = atan2(-d.X(), d.Z());
+	return Vec3(pitch * 180 / pi, yaw * 180 / pi, 0);
+}
+
+/// <summary>
+/// Turntable camera path: frame f of frameCount sits on a circle of radius around target,
+/// height above it, f / frameCount of the way round and looking at target. Frame 0 is on the
+/// near side (-Z of target), where the scenes put their camera.
+/// </summary>
+inline std::function<CameraPose(int)> OrbitPath(const Vec3& target, double radius, double height, int frameCount)
+{
+	return [=](int frame)
+	{
+		double angle = 2 * pi * frame / std::max(1, frameCount);
+		Vec3 position = target + Vec3(radius * sin(angle), height, -radius * cos(angle));
+		return CameraPose{ position, LookAtRotation(position, target) };
+	};
+}
+
+/// <summary>
+/// The rotating camera of the window: stays at start.position and turns degreesPerFrame about Y
+/// every frame, the same as Scene::cameraRot in RenderQuad.
+/// </summary>
+inline std::function<CameraPose(int)> SpinPath(const CameraPose& start, double degreesPerFrame)
+{
+	return [=](int frame) { return CameraPose{ start.position, start.rotation + Vec3(0, degreesPerFrame * frame, 0) }; };
+}
+
+/// <summary>
+/// True if pattern is safe to give printf one int: exactly one %d, optionally with a zero padded
+/// width like %04d, and no conversions other than %% escapes.
+/// </summary>
+inline bool IsFramePattern(const std::string& pattern)
+{
+	int conversions = 0;
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%') continue;
+		if (++i < pattern.size() && pattern[i] == '%') continue;
+		while (i < pattern.size() && isdigit((unsigned char)pattern[i])) i++;
+		if (i == pattern.size() || pattern[i] != 'd') return false;
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+// output if it is a frame pattern, otherwise output with its % escaped and _%04d before the
+// extension (out.png -> out_%04d.png)
+inline std::string FramePattern(const std::string& output)
+{
+	if (IsFramePattern(output)) return output;
+	std::string escaped;
+	for (char c : output)
+	{
+		if (c == '%') escaped += '%';
+		escaped += c;
+	}
+	size_t dot = escaped.find_last_of('.');
+	size_t slash = escaped.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return escaped + "_%04d.png";
+	return escaped.substr(0, dot) + "_%04d" + escaped.substr(dot);
+}
+
+/// <summary>
+/// Renders the frames of a camera path into a numbered image sequence. One camera, thread pool
+/// and acceleration structure serve every frame, and frame k is saved on encodeThreads
+/// background threads while frame k + 1 renders, so the render workers don't wait for PNG
+/// compression unless the encoders fall maxPendingFrames frames behind.
+/// </summary>
+class SequenceRenderer
+{
+public:
+	// printf pattern for the file names, given the frame number. One that isn't a frame pattern
+	// gets _%04d appended, see FramePattern()
+	std::string outputPattern = "frame_%04d.png";
+	// 0 uses every hardware thread, the PNG strips of a frame are compressed in parallel
+	int encodeThreads = 0;
+	int maxPendingFrames = 2;
+	int firstFrame = 0;
+
+	// Seconds spent rendering, and waiting for a free encode slot, in the last Render()
+	double renderSeconds = 0;
+	double stallSeconds = 0;
+	double totalSeconds = 0;
+
+	/// <summary>
+	/// Renders frames firstFrame to firstFrame + frameCount - 1 with path(frame) as the camera
+	/// pose. The camera's outputPath and hdrOutputPath are ignored while the sequence renders.
+	/// Returns false if a frame could not be written.
+	/// </summary>
+	bool Render(Camera& camera, RenderedObject& scene, const MaterialTable& materials, int frameCount, const std::function<CameraPose(int)>& path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::string outputPath = camera.outputPath;
+		std::string hdrOutputPath = camera.hdrOutputPath;
+		camera.outputPath.clear();
+		camera.hdrOutputPath.clear();
+
+		renderSeconds = 0;
+		bool ok;
+		{
+			EncodeQueue encoder(encodeThreads, maxPendingFrames);
+			for (int frame = firstFrame; frame < firstFrame + frameCount; frame++)
+			{
+				TraceScope trace("frame", "sequence", "frame", frame);
+				CameraPose pose = path(frame);
+				camera.cameraCenter = pose.position;
+				camera.cameraRotation = pose.rotation;
+
+				auto renderStart = std::chrono::high_resolution_clock::now();
+				uint8_t* imageData = camera.Render(scene, materials);
+				renderSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - renderStart).count();
+
+				encoder.Push(FramePath(frame), camera.imageWidth, camera.imageHeight, imageData);
+			}
+			ok = encoder.Finish();
+			stallSeconds = encoder.StallSeconds();
+		}
+
+		camera.outputPath = outputPath;
+		camera.hdrOutputPath = hdrOutputPath;
+		totalSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return ok;
+	}
+
+	std::string FramePath(int frame) const
+	{
+		char name[1024];
+		snprintf(name, sizeof(name), FramePattern(outputPattern).c_str(), frame);
+		return name;
+	}
+};
+
+#endif
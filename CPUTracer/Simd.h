@@ -0,0 +1,93 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Build-time SIMD switch for the CPU tracer.
+// Define SPEEDTRACER_SIMD as one of the levels below to force a path, e.g. /DSPEEDTRACER_SIMD=0
+// for the scalar fallback. Left undefined it follows the compiler's target (/arch:AVX2, -mavx2).
+#define SIMD_SCALAR 0
+#define SIMD_SSE 1
+#define SIMD_AVX2 2
+
+#ifndef SPEEDTRACER_SIMD
+#if defined(__AVX2__)
+#define SPEEDTRACER_SIMD SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPEEDTRACER_SIMD SIMD_SSE
+#else
+#define SPEEDTRACER_SIMD SIMD_SCALAR
+#endif
+#endif
+
+#if SPEEDTRACER_SIMD != SIMD_SCALAR
+#include <immintrin.h>
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Lanes in one float register of the selected path
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+const int simdWidth = 8;
+#else
+const int simdWidth = 4;
+#endif
+
+inline const char* SimdName()
+{
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+	return "AVX2";
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+	return "SSE";
+#else
+	return "Scalar";
+#endif
+}
+
+// Cache line size used to align packed SIMD data
+const int cacheLineSize = 64;
+
+/// <summary>
+/// Allocator for std::vector that places the elements on Alignment byte boundaries,
+/// needed for node and lane arrays that are read with aligned SIMD loads.
+/// </summary>
+template<typename T, size_t Alignment = cacheLineSize>
+struct AlignedAllocator
+{
+	using value_type = T;
+	template<typename U> struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() = default;
+	template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+#ifdef _MSC_VER
+		void* p = _aligned_malloc(bytes, Alignment);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, Alignment, bytes) != 0) p = nullptr;
+#endif
+		if (!p) throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+	void deallocate(T* p, size_t)
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+	template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif
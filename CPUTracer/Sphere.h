@@ -2,20 +2,22 @@
 #define SPHERE_H
 
 #include "RenderedObject.h"
+#include "RenderStats.h"
 
 class Sphere : public RenderedObject
 {
 public:
     Vec3 center;
     double radius;
-    shared_ptr<Material> mat;
-    Sphere(const Vec3& center, double r, shared_ptr<Material> mat) : center(center), radius(std::fmax(0, r)), mat(mat)
+    uint32_t materialId;
+    Sphere(const Vec3& center, double r, uint32_t materialId) : center(center), radius(std::fmax(0, r)), materialId(materialId)
     {
 
     }
 
     bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const override
     {
+        SPEEDTRACER_COUNT(primitiveTests, 1);
         Vec3 oc = center - r.Origin();
         auto a = r.Direction().LengthSquared();
         auto h = Dot(r.Direction(), oc);
@@ -39,10 +41,15 @@ public:
         hit.p = r.At(hit.t);
         Vec3 outwardNormal = (hit.p - center) / radius;
         hit.SetFaceNormal(r, outwardNormal);
-        hit.mat = mat;
+        hit.materialId = materialId;
 
         return true;
     }
+    AABB BoundingBox() const override
+    {
+        Vec3 extent(radius, radius, radius);
+        return AABB(center - extent, center + extent);
+    }
 private:
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,292 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include "RenderedObject.h"
+#include "Sphere.h"
+#include "Simd.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+
+/// <summary>
+/// Packed sphere store. Centers, radius squared and material ids live in separate aligned arrays
+/// so one SIMD kernel tests simdWidth spheres at a time in float. The nearest candidate is then
+/// re-tested in double with the same math as Sphere::CheckHit, so hits match the scalar spheres.
+/// </summary>
+class SphereSoA : public RenderedObject
+{
+public:
+	AlignedVector<float> centerX;
+	AlignedVector<float> centerY;
+	AlignedVector<float> centerZ;
+	AlignedVector<float> radiusSquared;
+	std::vector<uint32_t> materialIds;
+
+	// Exact values for the double precision re-test
+	std::vector<Vec3> centers;
+	std::vector<double> radii;
+
+	// Runs the scalar kernel even when a SIMD path is compiled in, for comparisons
+	bool useSimd = true;
+
+	SphereSoA() {}
+	SphereSoA(const std::vector<shared_ptr<RenderedObject>>& objects)
+	{
+		for (const auto& object : objects)
+		{
+			if (const Sphere* sphere = dynamic_cast<const Sphere*>(object.get())) Add(*sphere);
+		}
+	}
+
+	int Size() const { return int(centers.size()); }
+
+	void Add(const Sphere& sphere)
+	{
+		// Drop the padding lanes, append, then pad back up to a whole SIMD block
+		centerX.resize(centers.size());
+		centerY.resize(centers.size());
+		centerZ.resize(centers.size());
+		radiusSquared.resize(centers.size());
+
+		centers.push_back(sphere.center);
+		radii.push_back(sphere.radius);
+		centerX.push_back(float(sphere.center.X()));
+		centerY.push_back(float(sphere.center.Y()));
+		centerZ.push_back(float(sphere.center.Z()));
+		radiusSquared.push_back(float(sphere.radius * sphere.radius));
+		materialIds.push_back(sphere.materialId);
+
+		while (centerX.size() % simdWidth != 0)
+		{
+			// Negative infinite radius squared never passes the discriminant test
+			centerX.push_back(0);
+			centerY.push_back(0);
+			centerZ.push_back(0);
+			radiusSquared.push_back(float(-infinity));
+		}
+	}
+
+	bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const override
+	{
+		if (centers.empty()) return false;
+		SPEEDTRACER_COUNT(primitiveTests, Size());
+
+		int index;
+#if SPEEDTRACER_SIMD != SIMD_SCALAR
+		if (useSimd) index = NearestSimd(r, rayT);
+		else
+#endif
+		index = NearestScalar(r, rayT);
+
+		if (index < 0) return false;
+		if (ExactHit(index, r, rayT, hit)) return true;
+
+		// The float kernel and the double test disagree on a grazing hit, settle it in double
+		bool hasHit = false;
+		for (int i = 0; i < Size(); i++)
+		{
+			if (ExactHit(i, r, rayT, hit))
+			{
+				hasHit = true;
+				rayT.max = hit.t;
+			}
+		}
+		return hasHit;
+	}
+	AABB BoundingBox() const override
+	{
+		AABB bounds;
+		for (int i = 0; i < Size(); i++)
+		{
+			Vec3 extent(radii[i], radii[i], radii[i]);
+			bounds.Expand(AABB(centers[i] - extent, centers[i] + extent));
+		}
+		return bounds;
+	}
+
+private:
+	// Float discriminants this far below zero (relative to h squared) still count as candidates,
+	// so rounding can't drop a grazing hit the double re-test would accept
+	static constexpr float grazeEpsilon = 1e-5f;
+
+	bool ExactHit(int i, const Ray& r, Interval rayT, HitInfo& hit) const
+	{
+		Vec3 oc = centers[i] - r.Origin();
+		auto a = r.Direction().LengthSquared();
+		auto h = Dot(r.Direction(), oc);
+		auto c = oc.LengthSquared() - radii[i] * radii[i];
+
+		auto discriminant = h * h - a * c;
+		if (discriminant < 0)
+			return false;
+
+		auto sqrtd = std::sqrt(discriminant);
+
+		auto root = (h - sqrtd) / a;
+		if (!rayT.ContainsExclusive(root)) {
+			root = (h + sqrtd) / a;
+			if (!rayT.ContainsExclusive(root))
+				return false;
+		}
+
+		hit.t = root;
+		hit.p = r.At(hit.t);
+		Vec3 outwardNormal = (hit.p - centers[i]) / radii[i];
+		hit.SetFaceNormal(r, outwardNormal);
+		hit.materialId = materialIds[i];
+		return true;
+	}
+
+	/// <summary>
+	/// Index of the sphere with the nearest root inside rayT, or -1.
+	/// </summary>
+	int NearestScalar(const Ray& r, Interval rayT) const
+	{
+		float ox = float(r.Origin().X()), oy = float(r.Origin().Y()), oz = float(r.Origin().Z());
+		float dx = float(r.Direction().X()), dy = float(r.Direction().Y()), dz = float(r.Direction().Z());
+		float a = dx * dx + dy * dy + dz * dz;
+		float invA = 1.0f / a;
+		float tMin = float(rayT.min);
+		float best = float(rayT.max);
+		int bestIndex = -1;
+
+		for (int i = 0; i < int(centerX.size()); i++)
+		{
+			float ocx = centerX[i] - ox, ocy = centerY[i] - oy, ocz = centerZ[i] - oz;
+			float h = dx * ocx + dy * ocy + dz * ocz;
+			float c = ocx * ocx + ocy * ocy + ocz * ocz - radiusSquared[i];
+			float discriminant = h * h - a * c;
+			if (discriminant < -grazeEpsilon * h * h) continue;
+
+			float sqrtd = std::sqrt(std::fmax(discriminant, 0.0f));
+			float t = (h - sqrtd) * invA;
+			if (t <= tMin) t = (h + sqrtd) * invA;
+			if (t > tMin && t < best)
+			{
+				best = t;
+				bestIndex = i;
+			}
+		}
+		return bestIndex;
+	}
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+	int NearestSimd(const Ray& r, Interval rayT) const
+	{
+		__m256 ox = _mm256_set1_ps(float(r.Origin().X()));
+		__m256 oy = _mm256_set1_ps(float(r.Origin().Y()));
+		__m256 oz = _mm256_set1_ps(float(r.Origin().Z()));
+		__m256 dx = _mm256_set1_ps(float(r.Direction().X()));
+		__m256 dy = _mm256_set1_ps(float(r.Direction().Y()));
+		__m256 dz = _mm256_set1_ps(float(r.Direction().Z()));
+		__m256 a = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_add_ps(_mm256_mul_ps(dy, dy), _mm256_mul_ps(dz, dz)));
+		__m256 invA = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+		__m256 tMin = _mm256_set1_ps(float(rayT.min));
+		__m256 zero = _mm256_setzero_ps();
+		__m256 graze = _mm256_set1_ps(-grazeEpsilon);
+
+		__m256 best = _mm256_set1_ps(float(rayT.max));
+		__m256 bestIndex = _mm256_set1_ps(-1.0f);
+		__m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 step = _mm256_set1_ps(8.0f);
+
+		for (size_t i = 0; i < centerX.size(); i += 8)
+		{
+			__m256 ocx = _mm256_sub_ps(_mm256_load_ps(&centerX[i]), ox);
+			__m256 ocy = _mm256_sub_ps(_mm256_load_ps(&centerY[i]), oy);
+			__m256 ocz = _mm256_sub_ps(_mm256_load_ps(&centerZ[i]), oz);
+			__m256 h = _mm256_add_ps(_mm256_mul_ps(dx, ocx), _mm256_add_ps(_mm256_mul_ps(dy, ocy), _mm256_mul_ps(dz, ocz)));
+			__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_add_ps(_mm256_mul_ps(ocy, ocy), _mm256_mul_ps(ocz, ocz))), _mm256_load_ps(&radiusSquared[i]));
+			__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a, c));
+			__m256 valid = _mm256_cmp_ps(discriminant, _mm256_mul_ps(graze, _mm256_mul_ps(h, h)), _CMP_GE_OQ);
+
+			__m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+			__m256 tNear = _mm256_mul_ps(_mm256_sub_ps(h, sqrtd), invA);
+			__m256 tFar = _mm256_mul_ps(_mm256_add_ps(h, sqrtd), invA);
+			__m256 t = _mm256_blendv_ps(tFar, tNear, _mm256_cmp_ps(tNear, tMin, _CMP_GT_OQ));
+			valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ), _mm256_cmp_ps(t, best, _CMP_LT_OQ)));
+
+			best = _mm256_blendv_ps(best, t, valid);
+			bestIndex = _mm256_blendv_ps(bestIndex, index, valid);
+			index = _mm256_add_ps(index, step);
+		}
+		return ReduceNearest(best, bestIndex);
+	}
+	static int ReduceNearest(__m256 best, __m256 bestIndex)
+	{
+		alignas(32) float t[8];
+		alignas(32) float indices[8];
+		_mm256_store_ps(t, best);
+		_mm256_store_ps(indices, bestIndex);
+		return ReduceLanes(t, indices, 8);
+	}
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+	// SSE2 has no blendv, select with bit masks
+	static __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+	int NearestSimd(const Ray& r, Interval rayT) const
+	{
+		__m128 ox = _mm_set1_ps(float(r.Origin().X()));
+		__m128 oy = _mm_set1_ps(float(r.Origin().Y()));
+		__m128 oz = _mm_set1_ps(float(r.Origin().Z()));
+		__m128 dx = _mm_set1_ps(float(r.Direction().X()));
+		__m128 dy = _mm_set1_ps(float(r.Direction().Y()));
+		__m128 dz = _mm_set1_ps(float(r.Direction().Z()));
+		__m128 a = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_add_ps(_mm_mul_ps(dy, dy), _mm_mul_ps(dz, dz)));
+		__m128 invA = _mm_div_ps(_mm_set1_ps(1.0f), a);
+		__m128 tMin = _mm_set1_ps(float(rayT.min));
+		__m128 zero = _mm_setzero_ps();
+		__m128 graze = _mm_set1_ps(-grazeEpsilon);
+
+		__m128 best = _mm_set1_ps(float(rayT.max));
+		__m128 bestIndex = _mm_set1_ps(-1.0f);
+		__m128 index = _mm_setr_ps(0, 1, 2, 3);
+		const __m128 step = _mm_set1_ps(4.0f);
+
+		for (size_t i = 0; i < centerX.size(); i += 4)
+		{
+			__m128 ocx = _mm_sub_ps(_mm_load_ps(&centerX[i]), ox);
+			__m128 ocy = _mm_sub_ps(_mm_load_ps(&centerY[i]), oy);
+			__m128 ocz = _mm_sub_ps(_mm_load_ps(&centerZ[i]), oz);
+			__m128 h = _mm_add_ps(_mm_mul_ps(dx, ocx), _mm_add_ps(_mm_mul_ps(dy, ocy), _mm_mul_ps(dz, ocz)));
+			__m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_add_ps(_mm_mul_ps(ocy, ocy), _mm_mul_ps(ocz, ocz))), _mm_load_ps(&radiusSquared[i]));
+			__m128 discriminant = _mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c));
+			__m128 valid = _mm_cmpge_ps(discriminant, _mm_mul_ps(graze, _mm_mul_ps(h, h)));
+
+			__m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+			__m128 tNear = _mm_mul_ps(_mm_sub_ps(h, sqrtd), invA);
+			__m128 tFar = _mm_mul_ps(_mm_add_ps(h, sqrtd), invA);
+			__m128 t = Select(_mm_cmpgt_ps(tNear, tMin), tNear, tFar);
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, best)));
+
+			best = Select(valid, t, best);
+			bestIndex = Select(valid, index, bestIndex);
+			index = _mm_add_ps(index, step);
+		}
+		return ReduceNearest(best, bestIndex);
+	}
+	static int ReduceNearest(__m128 best, __m128 bestIndex)
+	{
+		alignas(16) float t[4];
+		alignas(16) float indices[4];
+		_mm_store_ps(t, best);
+		_mm_store_ps(indices, bestIndex);
+		return ReduceLanes(t, indices, 4);
+	}
+#endif
+	static int ReduceLanes(const float* t, const float* indices, int lanes)
+	{
+		int bestLane = -1;
+		for (int i = 0; i < lanes; i++)
+		{
+			if (indices[i] >= 0 && (bestLane < 0 || t[i] < t[bestLane])) bestLane = i;
+		}
+		return bestLane < 0 ? -1 : int(indices[bestLane]);
+	}
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+/// <summary>
+/// Fixed set of worker threads that live as long as the pool and run one job at a time, so
+/// renders don't pay for thread creation and workers keep their caches between frames.
+/// With pinning on, worker i is bound to the i-th CPU in NUMA node order: neighbouring worker
+/// indices share a node, and the tile scheduler steals from neighbours first.
+/// </summary>
+class ThreadPool
+{
+public:
+	struct Stats
+	{
+		int workerCount = 0;
+		int nodeCount = 1;			// NUMA nodes the pinned workers are spread over
+		bool pinned = false;
+		long long jobs = 0;
+		double lastUtilization = 0;	// Busy time of all workers / (workers * wall time) of the last job
+		double utilization = 0;		// The same over every job so far
+	};
+
+	// workerCount 0 uses every hardware thread
+	explicit ThreadPool(int workerCount = 0, bool pinThreads = false)
+	{
+		if (workerCount <= 0) workerCount = std::max(1, int(std::thread::hardware_concurrency()));
+		stats.workerCount = workerCount;
+		busyMs.resize(workerCount);
+
+		std::vector<int> cpus;
+		if (pinThreads) cpus = CpuOrder(stats.nodeCount);
+		for (int w = 0; w < workerCount; w++)
+		{
+			threads.emplace_back(&ThreadPool::WorkerLoop, this, w);
+			if (!cpus.empty()) stats.pinned |= Pin(threads.back(), cpus[w % cpus.size()]);
+		}
+		if (!stats.pinned) stats.nodeCount = 1;
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads) t.join();
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int WorkerCount() const { return stats.workerCount; }
+	bool Pinned() const { return stats.pinned; }
+	Stats GetStats() const { return stats; }
+
+	/// <summary>
+	/// Runs job(worker) once on every worker and blocks until all of them return.
+	/// </summary>
+	void Run(const std::function<void(int)>& newJob)
+	{
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &newJob;
+			running = WorkerCount();
+			generation++;
+		}
+		wake.notify_all();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&]() { return running == 0; });
+		job = nullptr;
+
+		double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		double busy = 0;
+		for (double ms : busyMs) busy += ms;
+		totalWallMs += wallMs * WorkerCount();
+		totalBusyMs += busy;
+		stats.jobs++;
+		stats.lastUtilization = wallMs > 0 ? busy / (wallMs * WorkerCount()) : 1;
+		stats.utilization = totalWallMs > 0 ? totalBusyMs / totalWallMs : 1;
+	}
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int)>* job = nullptr;
+	long long generation = 0;
+	int running = 0;
+	bool stopping = false;
+
+	std::vector<double> busyMs;	// Written by each worker for its own slot, read once running hits 0
+	double totalWallMs = 0;
+	double totalBusyMs = 0;
+	Stats stats;
+
+	void WorkerLoop(int worker)
+	{
+		GlobalTracer().NameThread("render worker " + std::to_string(worker));
+		long long seen = 0;
+		while (true)
+		{
+			const std::function<void(int)>* current;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				current = job;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			(*current)(worker);
+			busyMs[worker] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0) done.notify_one();
+		}
+	}
+
+	/// <summary>
+	/// CPUs this process may run on, grouped by NUMA node. Falls back to a single node when the
+	/// node layout isn't available.
+	/// </summary>
+	static std::vector<int> CpuOrder(int& nodeCount)
+	{
+		std::vector<int> order;
+		nodeCount = 1;
+#ifdef __linux__
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return order;
+
+		int nodes = 0;
+		for (int node = 0; ; node++)
+		{
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			if (!file) break;
+			std::string list;
+			std::getline(file, list);
+
+			bool any = false;
+			for (int cpu : ParseCpuList(list))
+			{
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && std::find(order.begin(), order.end(), cpu) == order.end())
+				{
+					order.push_back(cpu);
+					any = true;
+				}
+			}
+			if (any) nodes++;
+		}
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &allowed) && std::find(order.begin(), order.end(), cpu) == order.end()) order.push_back(cpu);
+		}
+		nodeCount = std::max(1, nodes);
+#else
+		for (int cpu = 0; cpu < int(std::thread::hardware_concurrency()); cpu++) order.push_back(cpu);
+#endif
+		return order;
+	}
+
+	// "0-3,8,10-11" to { 0, 1, 2, 3, 8, 10, 11 }
+	static std::vector<int> ParseCpuList(const std::string& list)
+	{
+		std::vector<int> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ','))
+		{
+			if (range.empty()) continue;
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	static bool Pin(std::thread& thread, int cpu)
+	{
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+		if (cpu >= int(sizeof(DWORD_PTR) * 8)) return false;
+		return SetThreadAffinityMask((HANDLE)thread.native_handle(), DWORD_PTR(1) << cpu) != 0;
+#else
+		return false;
+#endif
+	}
+};
+
+#endif
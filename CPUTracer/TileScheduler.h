@@ -0,0 +1,93 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include "Simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Pixel rectangle [x0, x1) x [y0, y1)
+struct Tile
+{
+	int x0, y0;
+	int x1, y1;
+
+	int Width() const { return x1 - x0; }
+	int Height() const { return y1 - y0; }
+};
+
+/// <summary>
+/// Splits an image into tiles and hands them to workers. Every worker starts with its own
+/// contiguous run of tiles in a deque and takes from the front; a worker that runs dry steals
+/// from the back of another worker's deque, so slow regions get shared out instead of leaving
+/// cores idle at the end of a frame.
+/// </summary>
+class TileScheduler
+{
+public:
+	TileScheduler(int imageWidth, int imageHeight, int tileSize, int workerCount)
+		: queues(size_t(std::max(1, workerCount)))
+	{
+		std::vector<Tile> tiles;
+		for (int y = 0; y < imageHeight; y += tileSize)
+			for (int x = 0; x < imageWidth; x += tileSize)
+				tiles.push_back(Tile{ x, y, std::min(x + tileSize, imageWidth), std::min(y + tileSize, imageHeight) });
+
+		workerCount = WorkerCount();
+		for (int w = 0; w < workerCount; w++)
+		{
+			size_t begin = tiles.size() * w / workerCount;
+			size_t end = tiles.size() * (w + 1) / workerCount;
+			queues[w].tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+		}
+	}
+
+	int WorkerCount() const { return int(queues.size()); }
+	int StealCount() const { return steals.load(); }
+
+	/// <summary>
+	/// Next tile for worker, from its own deque or stolen from another. False once every tile is taken.
+	/// </summary>
+	bool Next(int worker, Tile& tile)
+	{
+		{
+			WorkerQueue& own = queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tiles.empty())
+			{
+				tile = own.tiles.front();
+				own.tiles.pop_front();
+				return true;
+			}
+		}
+		for (int i = 1; i < WorkerCount(); i++)
+		{
+			WorkerQueue& victim = queues[(worker + i) % WorkerCount()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tiles.empty())
+			{
+				tile = victim.tiles.back();
+				victim.tiles.pop_back();
+				steals++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	// One cache line each so workers locking their own queue don't false share. The aligned
+	// allocator keeps them on line boundaries, plain new ignores alignas before C++17
+	struct alignas(cacheLineSize) WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Tile> tiles;
+	};
+	AlignedVector<WorkerQueue> queues;
+	std::atomic<int> steals{ 0 };
+};
+
+#endif
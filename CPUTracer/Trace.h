@@ -0,0 +1,215 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Define SPEEDTRACER_TRACING as 0 to compile every TraceScope down to nothing
+#ifndef SPEEDTRACER_TRACING
+#define SPEEDTRACER_TRACING 1
+#endif
+
+/// <summary>
+/// Timeline of what every thread did, written as Chrome trace JSON for chrome://tracing or
+/// ui.perfetto.dev. Events go into a fixed ring buffer: a writer claims a slot with one atomic
+/// add and publishes it with a sequence number, so threads never wait on each other and a full
+/// buffer overwrites the oldest events. Recording is off until Start(); a TraceScope costs one
+/// atomic load while it is off. Start() and WriteChromeJson() expect no render to be running.
+/// </summary>
+class Tracer
+{
+public:
+	// Names of up to two integer arguments, shown in the event's details
+	struct Args
+	{
+		const char* names[2];
+		long long values[2];
+	};
+
+	// capacity is rounded up to a power of two events, under 100 bytes each
+	void Start(size_t capacity = size_t(1) << 16)
+	{
+		size_t size = 1;
+		while (size < capacity) size <<= 1;
+		slots.reset(new Slot[size]);
+		mask = size - 1;
+		next.store(0, std::memory_order_relaxed);
+		origin = std::chrono::steady_clock::now();
+		enabled.store(true, std::memory_order_release);
+	}
+	void Stop() { enabled.store(false, std::memory_order_release); }
+	bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	// Nanoseconds since Start()
+	long long Now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count(); }
+
+	// Events recorded since Start(), including any the ring has overwritten
+	unsigned long long Recorded() const { return next.load(std::memory_order_relaxed); }
+
+	// Tracks that aren't threads, e.g. the GPU. Thread ids count up from 1 and never get this high
+	static const int gpuTrack = 1 << 20;
+
+	// track 0 puts the event on the calling thread's track
+	void Record(const char* name, const char* category, long long start, long long end, const Args& args, int track = 0)
+	{
+		if (!Enabled()) return;
+		uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = slots[index & mask];
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name = name;
+		slot.category = category;
+		slot.start = start;
+		slot.duration = end - start;
+		slot.thread = track ? track : ThreadId();
+		slot.args = args;
+		slot.sequence.store(index + 1, std::memory_order_release);
+	}
+
+	// Small id of the calling thread, the tid of its events
+	static int ThreadId()
+	{
+		static std::atomic<int> nextId(0);
+		thread_local int id = ++nextId;
+		return id;
+	}
+
+	// Names the calling thread's track in the trace. Names outlive Start(), so pool threads name themselves once
+	void NameThread(const std::string& name) { NameTrack(ThreadId(), name); }
+	void NameTrack(int track, const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(namesMutex);
+		threadNames[track] = name;
+	}
+
+	/// <summary>
+	/// Writes the events in the buffer to path as Chrome trace JSON, complete ("X") events with
+	/// microsecond timestamps plus a name for every named thread. Returns false if the file could
+	/// not be written.
+	/// </summary>
+	bool WriteChromeJson(const std::string& path) const
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file) return false;
+
+		struct Event
+		{
+			const char* name;
+			const char* category;
+			long long start;
+			long long duration;
+			int thread;
+			Args args;
+		};
+		std::vector<Event> events;
+		uint64_t count = next.load(std::memory_order_acquire);
+		uint64_t first = slots && count > mask + 1 ? count - (mask + 1) : 0;
+		for (uint64_t index = first; slots && index < count; index++)
+		{
+			const Slot& slot = slots[index & mask];
+			if (slot.sequence.load(std::memory_order_acquire) != index + 1) continue;
+			Event event{ slot.name, slot.category, slot.start, slot.duration, slot.thread, slot.args };
+			// Skip a slot a late writer reused while it was being copied
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == index + 1) events.push_back(event);
+		}
+		std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.start < b.start; });
+
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"SpeedTracer\"}}");
+		{
+			std::lock_guard<std::mutex> lock(namesMutex);
+			for (const auto& thread : threadNames)
+				fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", thread.first, thread.second.c_str());
+		}
+		for (const Event& e : events)
+		{
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", e.name, e.category, e.thread,
+				e.start / 1000.0, e.duration / 1000.0);
+			if (e.args.names[0])
+			{
+				fprintf(file, ",\"args\":{\"%s\":%lld", e.args.names[0], e.args.values[0]);
+				if (e.args.names[1]) fprintf(file, ",\"%s\":%lld", e.args.names[1], e.args.values[1]);
+				fprintf(file, "}");
+			}
+			fprintf(file, "}");
+		}
+		fprintf(file, "\n]}\n");
+		return fclose(file) == 0;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence{ 0 };	// Index + 1 of the event in the slot, 0 while it is written
+		const char* name = nullptr;
+		const char* category = nullptr;
+		long long start = 0;
+		long long duration = 0;
+		int thread = 0;
+		Args args = {};
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	uint64_t mask = 0;
+	std::atomic<uint64_t> next{ 0 };
+	std::atomic<bool> enabled{ false };
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	mutable std::mutex namesMutex;
+	std::map<int, std::string> threadNames;
+};
+
+// The process wide tracer every TraceScope records into
+inline Tracer& GlobalTracer()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+#if SPEEDTRACER_TRACING
+/// <summary>
+/// Records the time from construction to destruction as one event on the calling thread's
+/// track. name and category must be string literals (or otherwise outlive the trace).
+/// </summary>
+class TraceScope
+{
+public:
+	TraceScope(const char* name, const char* category, const char* arg0 = nullptr, long long value0 = 0, const char* arg1 = nullptr, long long value1 = 0)
+	{
+		if (!GlobalTracer().Enabled()) return;
+		this->name = name;
+		this->category = category;
+		args = Tracer::Args{ { arg0, arg1 }, { value0, value1 } };
+		start = GlobalTracer().Now();
+	}
+	~TraceScope()
+	{
+		if (start >= 0) GlobalTracer().Record(name, category, start, GlobalTracer().Now(), args);
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name = nullptr;
+	const char* category = nullptr;
+	Tracer::Args args = {};
+	long long start = -1;
+};
+#else
+class TraceScope
+{
+public:
+	TraceScope(const char*, const char*, const char* = nullptr, long long = 0, const char* = nullptr, long long = 0) {}
+};
+#endif
+
+#endif
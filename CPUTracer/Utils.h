@@ -18,6 +18,6 @@ using std::shared_ptr;
 #include "Color.h"
 #include "Ray.h"
 #include "Vec3.h"
-#include "interval.h"
+#include "Interval.h"
 
 #endif
\ No newline at end of file
@@ -64,7 +64,7 @@ inline Vec3 operator*(const Vec3& a, const Vec3& b) { return Vec3(a.e[0] * b.e[0
 
 inline Vec3 operator*(double v, const Vec3& vec) { return Vec3(v * vec.e[0], v * vec.e[1], v * vec.e[2]); }
 
-inline Vec3 operator*(const Vec3& vec, double v) { return vec * v; }
+inline Vec3 operator*(const Vec3& vec, double v) { return v * vec; }
 
 inline Vec3 operator/(const Vec3& vec, double v) { return (1 / v) * vec; }
 
@@ -83,6 +83,18 @@ inline Vec3 Cross(const Vec3& a, const Vec3& b) {
 inline Vec3 Normalize(const Vec3& vec) {
 	return vec / vec.Length();
 }
+/// <summary>
+/// Rotates v by Euler angles in degrees, X first then Y then Z, the same as rotateVec3Euler in
+/// GPUscreen.frag so Scene::cameraRot points both tracers the same way.
+/// </summary>
+inline Vec3 RotateEuler(const Vec3& v, const Vec3& degrees)
+{
+	double rx = degrees.X() * pi / 180.0, ry = degrees.Y() * pi / 180.0, rz = degrees.Z() * pi / 180.0;
+	double cx = cos(rx), sx = sin(rx), cy = cos(ry), sy = sin(ry), cz = cos(rz), sz = sin(rz);
+	Vec3 a(v.X(), cx * v.Y() + sx * v.Z(), -sx * v.Y() + cx * v.Z());
+	Vec3 b(cy * a.X() - sy * a.Z(), a.Y(), sy * a.X() + cy * a.Z());
+	return Vec3(cz * b.X() + sz * b.Y(), -sz * b.X() + cz * b.Y(), b.Z());
+}
 static Vec3 RandomVec3()
 {
 	return Vec3(RandomDouble(), RandomDouble(), RandomDouble());
@@ -101,6 +113,22 @@ inline Vec3 RandomUnitVector()
 			return p / sqrt(lengthSquared);
 	}
 }
+inline Vec3 RandomVec3(Sampler& sampler)
+{
+	return Vec3(sampler.Next(), sampler.Next(), sampler.Next());
+}
+/// <summary>
+/// The same directions as RandomUnitVector() (uniform over the octant where every component is
+/// positive) from exactly two sampler dimensions instead of a rejection loop, so low discrepancy
+/// samplers stratify them: z uniform in [0,1] is uniform in area on the sphere.
+/// </summary>
+inline Vec3 RandomUnitVector(Sampler& sampler)
+{
+	double z = sampler.Next();
+	double phi = sampler.Next() * pi / 2;
+	double r = sqrt(std::fmax(0.0, 1 - z * z));
+	return Vec3(r * cos(phi), r * sin(phi), z);
+}
 inline Vec3 RandomOnHemisphere(const Vec3& normal)
 {
 	Vec3 onUnitSphere = RandomUnitVector();
@@ -0,0 +1,193 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "RenderedObject.h"
+#include "Material.h"
+#include "PathTracer.h"
+#include "RenderStats.h"
+
+#include <vector>
+
+/// <summary>
+/// Breadth first path tracer. Instead of following one path to the end like TracePath it
+/// keeps a queue of active paths and advances all of them one bounce per stage: intersect the
+/// whole queue (sorted by direction octant), then bin the hits by material type and shade each
+/// bin with one ScatterN call.
+/// </summary>
+class WavefrontIntegrator
+{
+public:
+	struct PathState
+	{
+		Ray ray;
+		Vec3 throughput;
+		int pixel;
+		int depth;	// Intersections left before the path ends black
+		Sampler sampler;
+	};
+
+	// Paths in flight. Larger queues give longer bins, but the path and hit records of the whole
+	// queue should still fit in L2 or every stage streams them from memory.
+	int queueSize;
+
+	WavefrontIntegrator(int queueSize = 1 << 10) : queueSize(queueSize) {}
+
+	/// <summary>
+	/// Traces samplesPerPixel paths for each of pixelCount pixels and adds their radiance to
+	/// accum[pixel]. generateRay(pixel, sampleIndex, sampler) starts sampler on that camera sample
+	/// and returns its ray, background(ray) gives the sky color. Bounce limit, Russian roulette and
+	/// the sampler bounces used match TracePath, so both integrators draw the same numbers.
+	/// rayCounts, when given, gets the intersection tests of each pixel's paths added to it, and
+	/// bounceRays[n] the rays traced at bounce n.
+	/// </summary>
+	template<typename GenerateRay, typename BackgroundColor>
+	void Render(const RenderedObject& scene, const MaterialTable& materials, int pixelCount, int samplesPerPixel, int maxDepth, int rouletteDepth,
+		GenerateRay generateRay, BackgroundColor background, Vec3* accum, const Sampler& baseSampler, float* rayCounts = nullptr, long long* bounceRays = nullptr)
+	{
+		this->maxDepth = maxDepth;
+		this->rouletteDepth = rouletteDepth;
+		long long nextSample = 0;
+		long long totalSamples = (long long)pixelCount * samplesPerPixel;
+		paths.clear();
+
+		while (true)
+		{
+			// Keep the queue full with new camera paths
+			while (int(paths.size()) < queueSize && nextSample < totalSamples)
+			{
+				int pixel = int(nextSample / samplesPerPixel);
+				int sampleIndex = int(nextSample % samplesPerPixel);
+				Sampler sampler = baseSampler;
+				Ray r = generateRay(pixel, sampleIndex, sampler);
+				paths.push_back(PathState{ r, Vec3(1, 1, 1), pixel, maxDepth, sampler });
+				nextSample++;
+			}
+			if (paths.empty()) break;
+
+			SortByDirection();
+			Intersect(scene);
+			if (rayCounts)
+				for (const PathState& path : paths)
+					if (path.depth > 0) rayCounts[path.pixel] += 1.0f;
+			if (bounceRays)
+				for (const PathState& path : paths)
+					if (path.depth > 0) bounceRays[maxDepth - path.depth]++;
+
+			next.clear();
+			for (auto& bin : bins) bin.clear();
+			for (int i = 0; i < int(paths.size()); i++)
+			{
+				const PathState& path = paths[i];
+				if (hitFlags[i]) bins[int(materials.Record(hits[i].materialId).type)].push_back(i);
+				else if (path.depth > 0) accum[path.pixel] += path.throughput * background(path.ray);
+			}
+
+			for (int type = 0; type < int(MaterialType::Count); type++)
+			{
+				ShadeBin(MaterialType(type), bins[type], materials);
+			}
+
+			paths.swap(next);
+		}
+	}
+
+private:
+	std::vector<PathState> paths;
+	std::vector<PathState> next;
+	std::vector<PathState> sorted;
+	std::vector<HitInfo> hits;
+	std::vector<char> hitFlags;
+	std::vector<int> bins[int(MaterialType::Count)];
+	int maxDepth = 0;
+	int rouletteDepth = 0;
+
+	// One bin gathered into contiguous arrays for ScatterN
+	std::vector<Ray> binRays;
+	std::vector<HitInfo> binHits;
+	std::vector<Vec3> binAttenuation;
+	std::vector<Ray> binScattered;
+	std::vector<uint8_t> binScatters;
+	std::vector<Sampler> binSamplers;
+
+	/// <summary>
+	/// Counting sort of the queue by ray direction octant so neighbouring intersection queries
+	/// walk similar parts of the acceleration structure.
+	/// </summary>
+	void SortByDirection()
+	{
+		int counts[9] = {};
+		for (const PathState& path : paths) counts[Octant(path.ray) + 1]++;
+		for (int i = 1; i < 9; i++) counts[i] += counts[i - 1];
+
+		sorted.resize(paths.size());
+		for (const PathState& path : paths) sorted[counts[Octant(path.ray)]++] = path;
+		paths.swap(sorted);
+	}
+	static int Octant(const Ray& r)
+	{
+		const Vec3& d = r.Direction();
+		return (d.X() < 0) | ((d.Y() < 0) << 1) | ((d.Z() < 0) << 2);
+	}
+	void Intersect(const RenderedObject& scene)
+	{
+		hits.resize(paths.size());
+		hitFlags.resize(paths.size());
+		for (int i = 0; i < int(paths.size()); i++)
+		{
+			// Paths out of bounces end black without another intersection, as in TracePath
+			hitFlags[i] = paths[i].depth > 0 && scene.CheckHit(paths[i].ray, Interval(0.003, infinity), hits[i]);
+			if (paths[i].depth == 0) SPEEDTRACER_COUNT(depthLimited, 1);
+			else
+			{
+				if (paths[i].depth == maxDepth) SPEEDTRACER_COUNT(primaryRays, 1);
+				else SPEEDTRACER_COUNT(secondaryRays, 1);
+				if (hitFlags[i]) SPEEDTRACER_COUNT(hits, 1);
+				else SPEEDTRACER_COUNT(escaped, 1);
+			}
+		}
+	}
+	void ShadeBin(MaterialType type, const std::vector<int>& bin, const MaterialTable& materials)
+	{
+		if (bin.empty()) return;
+		int count = int(bin.size());
+		binRays.resize(count);
+		binHits.resize(count);
+		binAttenuation.resize(count);
+		binScattered.resize(count);
+		binScatters.resize(count);
+		binSamplers.resize(count);
+		for (int k = 0; k < count; k++)
+		{
+			const PathState& path = paths[bin[k]];
+			binRays[k] = path.ray;
+			binHits[k] = hits[bin[k]];
+			// Same bounce numbering as TracePath
+			binSamplers[k] = path.sampler;
+			binSamplers[k].StartBounce(uint32_t(maxDepth - path.depth + 1));
+		}
+
+		ScatterN(type, count, materials.Records(), binRays.data(), binHits.data(), binAttenuation.data(), binScattered.data(), binScatters.data(), binSamplers.data());
+
+		for (int k = 0; k < count; k++)
+		{
+			if (!binScatters[k])
+			{
+				SPEEDTRACER_COUNT(absorbed, 1);
+				continue;
+			}
+			const PathState& path = paths[bin[k]];
+			Vec3 throughput = path.throughput * binAttenuation[k];
+
+			// Bounces done after this one, same roulette rule as TracePath
+			int bounces = maxDepth - path.depth + 1;
+			if (bounces >= rouletteDepth && path.depth - 1 > 0 && !SurviveRoulette(throughput, binSamplers[k]))
+			{
+				SPEEDTRACER_COUNT(rouletteKills, 1);
+				continue;
+			}
+			next.push_back(PathState{ binScattered[k], throughput, path.pixel, path.depth - 1, binSamplers[k] });
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "RenderedObject.h"
+#include "BVH.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+
+/// <summary>
+/// BVH with simdWidth (4 for SSE/scalar, 8 for AVX2) children per node. Each node stores its
+/// children's boxes as structure of arrays so one traversal step slab tests every child at once.
+/// Built by collapsing the binary SAH BVH; nodes are a flat, cache line aligned array.
+/// </summary>
+class WideBVH : public RenderedObject
+{
+public:
+	static const int width = simdWidth;
+
+	struct alignas(cacheLineSize) Node
+	{
+		float minX[width];
+		float minY[width];
+		float minZ[width];
+		float maxX[width];
+		float maxY[width];
+		float maxZ[width];
+		int child[width];	// Interior: node index. Leaf: first primitive.
+		int count[width];	// Leaf: primitive count. 0 for interior children and empty slots.
+	};
+
+	AlignedVector<Node> nodes;
+	std::vector<shared_ptr<RenderedObject>> primitives;
+	// Runs the scalar slab test even when a SIMD path is compiled in, for comparisons
+	bool useSimd = true;
+
+	WideBVH(const std::vector<shared_ptr<RenderedObject>>& objects, int maxLeafSize = 4)
+	{
+		TraceScope trace("WideBVH build", "build", "objects", (long long)objects.size());
+		BVH binary(objects, maxLeafSize);
+		primitives = binary.primitives;
+		if (binary.nodes.empty()) return;
+
+		nodes.reserve(binary.nodes.size() / 2 + 1);
+		if (binary.nodes[0].primitiveCount > 0)
+		{
+			nodes.push_back(EmptyNode());
+			SetChild(0, 0, binary.nodes[0]);
+			nodes[0].child[0] = binary.nodes[0].offset;
+			nodes[0].count[0] = binary.nodes[0].primitiveCount;
+		}
+		else
+		{
+			Collapse(binary, 0);
+		}
+	}
+
+	bool CheckHit(const Ray& r, Interval rayT, HitInfo& hit) const override
+	{
+		if (nodes.empty()) return false;
+#if SPEEDTRACER_SIMD != SIMD_SCALAR
+		if (useSimd) return Traverse<true>(r, rayT, hit);
+#endif
+		return Traverse<false>(r, rayT, hit);
+	}
+	uint64_t CheckHitPacket(RayPacket& packet, HitInfo hits[]) const override
+	{
+		if (nodes.empty() || packet.size == 0) return 0;
+
+		// The packet is coherent, so the first ray picks the traversal order for all of them
+		const Vec3& origin = packet.rays[0].Origin();
+		const Vec3& d = packet.rays[0].Direction();
+
+		struct PacketEntry
+		{
+			int child;
+			int count;
+			uint64_t active;
+		};
+		uint64_t hitMask = 0;
+		PacketEntry stack[BVH::traversalStackSize * width];
+		int stackSize = 0;
+		stack[stackSize++] = PacketEntry{ 0, 0, packet.AllRays() };
+		while (stackSize > 0)
+		{
+			PacketEntry entry = stack[--stackSize];
+			if (entry.count > 0)
+			{
+				for (int i = 0; i < entry.count; i++)
+				{
+					hitMask |= CheckHitActive(*primitives[entry.child + i], packet, entry.active, hits);
+				}
+				continue;
+			}
+
+			const Node& node = nodes[entry.child];
+			// Push hit children far to near along the first ray so the nearest one is popped first
+			int first = stackSize;
+			double distance[width];
+			for (int i = 0; i < width; i++)
+			{
+				AABB box = ChildBounds(node, i);
+				if (box.IsEmpty()) continue;
+				if (packet.hasFrustum && packet.frustum.Culls(box)) continue;
+
+				uint64_t active = packet.IntersectBox(box, entry.active);
+				if (!active) continue;
+
+				PacketEntry child = { node.child[i], node.count[i], active };
+				double childDistance = Dot(box.Centroid() - origin, d);
+				int j = stackSize++;
+				while (j > first && distance[j - 1 - first] < childDistance)
+				{
+					stack[j] = stack[j - 1];
+					distance[j - first] = distance[j - 1 - first];
+					j--;
+				}
+				stack[j] = child;
+				distance[j - first] = childDistance;
+			}
+		}
+		return hitMask;
+	}
+	AABB BoundingBox() const override
+	{
+		AABB bounds;
+		if (nodes.empty()) return bounds;
+		for (int i = 0; i < width; i++)
+		{
+			if (nodes[0].minX[i] > nodes[0].maxX[i]) continue;
+			bounds.Expand(ChildBounds(nodes[0], i));
+		}
+		return bounds;
+	}
+
+private:
+	struct RayData
+	{
+		float origin[3];
+		float invDir[3];
+		int dirIsNeg[3];
+	};
+	struct StackEntry
+	{
+		int child;
+		int count;
+		float tNear;
+	};
+	// Widens the far slab distance so float rounding can't reject a box the double ray touches
+	static constexpr float farScale = 1.0000004f;
+
+	static AABB ChildBounds(const Node& node, int i)
+	{
+		return AABB(Vec3(node.minX[i], node.minY[i], node.minZ[i]), Vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+	}
+	static Node EmptyNode()
+	{
+		Node node;
+		for (int i = 0; i < width; i++)
+		{
+			node.minX[i] = node.minY[i] = node.minZ[i] = float(infinity);
+			node.maxX[i] = node.maxY[i] = node.maxZ[i] = float(-infinity);
+			node.child[i] = 0;
+			node.count[i] = 0;
+		}
+		return node;
+	}
+	void SetChild(int nodeIndex, int slot, const BVH::Node& binaryNode)
+	{
+		// Round outwards so the float box still encloses the double one
+		Node& node = nodes[nodeIndex];
+		const AABB& b = binaryNode.bounds;
+		node.minX[slot] = std::nextafter(float(b.min.X()), -HUGE_VALF);
+		node.minY[slot] = std::nextafter(float(b.min.Y()), -HUGE_VALF);
+		node.minZ[slot] = std::nextafter(float(b.min.Z()), -HUGE_VALF);
+		node.maxX[slot] = std::nextafter(float(b.max.X()), HUGE_VALF);
+		node.maxY[slot] = std::nextafter(float(b.max.Y()), HUGE_VALF);
+		node.maxZ[slot] = std::nextafter(float(b.max.Z()), HUGE_VALF);
+	}
+	int Collapse(const BVH& binary, int binaryIndex)
+	{
+		// Open up the largest interior child until the node is full
+		std::vector<int> slots = { binaryIndex + 1, binary.nodes[binaryIndex].offset };
+		while (int(slots.size()) < width)
+		{
+			int largest = -1;
+			double largestArea = -1;
+			for (int i = 0; i < int(slots.size()); i++)
+			{
+				const BVH::Node& candidate = binary.nodes[slots[i]];
+				if (candidate.primitiveCount == 0 && candidate.bounds.SurfaceArea() > largestArea)
+				{
+					largest = i;
+					largestArea = candidate.bounds.SurfaceArea();
+				}
+			}
+			if (largest < 0) break;
+			int opened = slots[largest];
+			slots[largest] = opened + 1;
+			slots.push_back(binary.nodes[opened].offset);
+		}
+
+		int nodeIndex = int(nodes.size());
+		nodes.push_back(EmptyNode());
+		for (int i = 0; i < int(slots.size()); i++)
+		{
+			const BVH::Node& binaryNode = binary.nodes[slots[i]];
+			SetChild(nodeIndex, i, binaryNode);
+			if (binaryNode.primitiveCount > 0)
+			{
+				nodes[nodeIndex].child[i] = binaryNode.offset;
+				nodes[nodeIndex].count[i] = binaryNode.primitiveCount;
+			}
+			else
+			{
+				int child = Collapse(binary, slots[i]);
+				nodes[nodeIndex].child[i] = child;
+			}
+		}
+		return nodeIndex;
+	}
+
+	/// <summary>
+	/// Slab tests all children of node against the ray. Returns a bitmask of the children that
+	/// were hit and writes each child's entry distance to tNear.
+	/// </summary>
+	static int IntersectChildrenScalar(const Node& node, const RayData& ray, float tMin, float tMax, float tNear[width])
+	{
+		const float* nearX = ray.dirIsNeg[0] ? node.maxX : node.minX;
+		const float* nearY = ray.dirIsNeg[1] ? node.maxY : node.minY;
+		const float* nearZ = ray.dirIsNeg[2] ? node.maxZ : node.minZ;
+		const float* farX = ray.dirIsNeg[0] ? node.minX : node.maxX;
+		const float* farY = ray.dirIsNeg[1] ? node.minY : node.maxY;
+		const float* farZ = ray.dirIsNeg[2] ? node.minZ : node.maxZ;
+
+		int mask = 0;
+		for (int i = 0; i < width; i++)
+		{
+			float t0 = tMin;
+			float t1 = tMax;
+			float tx0 = (nearX[i] - ray.origin[0]) * ray.invDir[0];
+			float ty0 = (nearY[i] - ray.origin[1]) * ray.invDir[1];
+			float tz0 = (nearZ[i] - ray.origin[2]) * ray.invDir[2];
+			float tx1 = (farX[i] - ray.origin[0]) * ray.invDir[0];
+			float ty1 = (farY[i] - ray.origin[1]) * ray.invDir[1];
+			float tz1 = (farZ[i] - ray.origin[2]) * ray.invDir[2];
+			// Written as comparisons so a NaN slab (origin on the plane, zero direction) is ignored
+			t0 = tx0 > t0 ? tx0 : t0;
+			t0 = ty0 > t0 ? ty0 : t0;
+			t0 = tz0 > t0 ? tz0 : t0;
+			t1 = tx1 < t1 ? tx1 : t1;
+			t1 = ty1 < t1 ? ty1 : t1;
+			t1 = tz1 < t1 ? tz1 : t1;
+			tNear[i] = t0;
+			if (t0 <= t1 * farScale) mask |= 1 << i;
+		}
+		return mask;
+	}
+#if SPEEDTRACER_SIMD == SIMD_AVX2
+	static int IntersectChildrenSimd(const Node& node, const RayData& ray, float tMin, float tMax, float tNear[width])
+	{
+		const float* nearX = ray.dirIsNeg[0] ? node.maxX : node.minX;
+		const float* nearY = ray.dirIsNeg[1] ? node.maxY : node.minY;
+		const float* nearZ = ray.dirIsNeg[2] ? node.maxZ : node.minZ;
+		const float* farX = ray.dirIsNeg[0] ? node.minX : node.maxX;
+		const float* farY = ray.dirIsNeg[1] ? node.minY : node.maxY;
+		const float* farZ = ray.dirIsNeg[2] ? node.minZ : node.maxZ;
+
+		__m256 ox = _mm256_set1_ps(ray.origin[0]);
+		__m256 oy = _mm256_set1_ps(ray.origin[1]);
+		__m256 oz = _mm256_set1_ps(ray.origin[2]);
+		__m256 ix = _mm256_set1_ps(ray.invDir[0]);
+		__m256 iy = _mm256_set1_ps(ray.invDir[1]);
+		__m256 iz = _mm256_set1_ps(ray.invDir[2]);
+
+		__m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearX), ox), ix);
+		__m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearY), oy), iy);
+		__m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearZ), oz), iz);
+		__m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farX), ox), ix);
+		__m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farY), oy), iy);
+		__m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farZ), oz), iz);
+
+		// max/min return the second operand for NaN lanes, keeping the ray interval
+		__m256 t0 = _mm256_max_ps(tx0, _mm256_max_ps(ty0, _mm256_max_ps(tz0, _mm256_set1_ps(tMin))));
+		__m256 t1 = _mm256_min_ps(tx1, _mm256_min_ps(ty1, _mm256_min_ps(tz1, _mm256_set1_ps(tMax))));
+		t1 = _mm256_mul_ps(t1, _mm256_set1_ps(farScale));
+
+		_mm256_storeu_ps(tNear, t0);
+		return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+	}
+#elif SPEEDTRACER_SIMD == SIMD_SSE
+	static int IntersectChildrenSimd(const Node& node, const RayData& ray, float tMin, float tMax, float tNear[width])
+	{
+		const float* nearX = ray.dirIsNeg[0] ? node.maxX : node.minX;
+		const float* nearY = ray.dirIsNeg[1] ? node.maxY : node.minY;
+		const float* nearZ = ray.dirIsNeg[2] ? node.maxZ : node.minZ;
+		const float* farX = ray.dirIsNeg[0] ? node.minX : node.maxX;
+		const float* farY = ray.dirIsNeg[1] ? node.minY : node.maxY;
+		const float* farZ = ray.dirIsNeg[2] ? node.minZ : node.maxZ;
+
+		__m128 ox = _mm_set1_ps(ray.origin[0]);
+		__m128 oy = _mm_set1_ps(ray.origin[1]);
+		__m128 oz = _mm_set1_ps(ray.origin[2]);
+		__m128 ix = _mm_set1_ps(ray.invDir[0]);
+		__m128 iy = _mm_set1_ps(ray.invDir[1]);
+		__m128 iz = _mm_set1_ps(ray.invDir[2]);
+
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearX), ox), ix);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearY), oy), iy);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearZ), oz), iz);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farX), ox), ix);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farY), oy), iy);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farZ), oz), iz);
+
+		// max/min return the second operand for NaN lanes, keeping the ray interval
+		__m128 t0 = _mm_max_ps(tx0, _mm_max_ps(ty0, _mm_max_ps(tz0, _mm_set1_ps(tMin))));
+		__m128 t1 = _mm_min_ps(tx1, _mm_min_ps(ty1, _mm_min_ps(tz1, _mm_set1_ps(tMax))));
+		t1 = _mm_mul_ps(t1, _mm_set1_ps(farScale));
+
+		_mm_storeu_ps(tNear, t0);
+		return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+	}
+#endif
+
+	template<bool Simd>
+	bool Traverse(const Ray& r, Interval rayT, HitInfo& hit) const
+	{
+		RayData ray;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			ray.origin[axis] = float(r.Origin()[axis]);
+			ray.invDir[axis] = float(1.0 / r.Direction()[axis]);
+			ray.dirIsNeg[axis] = ray.invDir[axis] < 0;
+		}
+
+		bool hasHit = false;
+		float tMin = float(rayT.min);
+		float tMax = float(rayT.max);
+
+		StackEntry stack[BVH::traversalStackSize * width];
+		int stackSize = 0;
+		stack[stackSize++] = StackEntry{ 0, 0, tMin };
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.tNear > tMax * farScale) continue;
+
+			if (entry.count > 0)
+			{
+				for (int i = 0; i < entry.count; i++)
+				{
+					if (primitives[entry.child + i]->CheckHit(r, rayT, hit))
+					{
+						hasHit = true;
+						rayT.max = hit.t;
+						tMax = float(hit.t);
+					}
+				}
+				continue;
+			}
+
+			const Node& node = nodes[entry.child];
+			float tNear[width];
+			int mask;
+#if SPEEDTRACER_SIMD != SIMD_SCALAR
+			if (Simd) mask = IntersectChildrenSimd(node, ray, tMin, tMax, tNear);
+			else
+#endif
+			mask = IntersectChildrenScalar(node, ray, tMin, tMax, tNear);
+
+			// Push hit children far to near so the nearest one is popped first
+			int first = stackSize;
+			for (int i = 0; i < width; i++)
+			{
+				if (!(mask & (1 << i))) continue;
+				StackEntry child = { node.child[i], node.count[i], tNear[i] };
+				int j = stackSize++;
+				while (j > first && stack[j - 1].tNear < child.tNear)
+				{
+					stack[j] = stack[j - 1];
+					j--;
+				}
+				stack[j] = child;
+			}
+		}
+		return hasHit;
+	}
+};
+
+#endif
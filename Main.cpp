@@ -10,110 +10,37 @@
 #include "Scene.h"
 #include "Sphere.h"
 #include "Camera.h"
+#include "Progressive.h"
+#include "BVH.h"
+#include "WideBVH.h"
 #include "Render.h"
+#include "Scenes.h"
+#include "Benchmark.h"
+#include "Verify.h"
 
-Scene TestScene()
+int main(int argc, char* argv[])
 {
-	//Materials
-	shared_ptr<Material> ground = make_shared<Lambertian>(Vec3(0.94, 0.94, 0.96));
-	shared_ptr<Material> red = make_shared<Emmisive>(Vec3(0.2, 0.2, 0.2), Vec3(0.7, 0.2, 0.2));
-	shared_ptr<Material> metalic = make_shared<Metal>(Vec3(0.8, 0.8, 0.8));
-	shared_ptr<Material> black = make_shared<Lambertian>(Vec3(0.1, 0.1, 0.1));
-
-	//Scene
-	Scene scene;
-	scene.backgroundTopColor = Vec3(0.0, 0.05, 0.1);
-	scene.backgroundBottomColor = Vec3(0.0, 0.0, 0.0);
-	scene.cameraPos = Vec3(0, 0, 0);
-
-	scene.Add(make_shared<Sphere>(Vec3(0, -100.5, 1), 100.0, ground));
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.5), 0.6, red));
-	scene.Add(make_shared<Sphere>(Vec3(-1.3, 0, 1.5), 0.8, metalic));
-	scene.Add(make_shared<Sphere>(Vec3(2, 0.7, 2), 0.5, black));
-	return scene;
-}
-Scene SampleScene()
-{
-	//Materials
-	shared_ptr<Material> material_ground = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.8));
-	shared_ptr<Material> material_center = make_shared<Lambertian>(Vec3(0.1, 0.2, 0.5));
-	shared_ptr<Material> material_left = make_shared<Metal>(Vec3(0.8, 0.8, 0.8));
-	shared_ptr<Material> material_right = make_shared<Metal>(Vec3(0.8, 0.6, 0.2));
-
-	//Scene
-	Scene scene;
-	scene.backgroundTopColor = Vec3(1.0, 1.0, 1.0);
-	scene.backgroundBottomColor = Vec3(0.5, 0.7, 1.0);
-	scene.cameraPos = Vec3(0, 0, 0);
-
-	scene.Add(make_shared<Sphere>(Vec3(0, -100.5, 1), 100.0, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, material_center));
-	scene.Add(make_shared<Sphere>(Vec3(-1.0, 0, 1.0), 0.5, material_left));
-	scene.Add(make_shared<Sphere>(Vec3(1, 0.0, 1.0), 0.5, material_right));
-	return scene;
-}
-Scene BasicScene()
-{
-	Scene scene;
-	scene.backgroundTopColor = Vec3(1.0, 1.0, 1.0);
-	scene.backgroundBottomColor = Vec3(0.5, 0.7, 1.0);
-	scene.cameraPos = Vec3(0, 0, 0);
-	shared_ptr<Material> material_ground = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0));
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, material_ground));
-	return scene;
-}
-Scene Room()
-{
-	Scene scene;
-	scene.backgroundTopColor = Vec3(1,1,1);
-	scene.backgroundBottomColor = Vec3(0.5,0.5,0.5);
-	
-	//Materials
-	shared_ptr<Material> material_ground = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0));
-	shared_ptr<Material> blueGlow = make_shared<Emmisive>(Vec3(0.6, 0.6, 0.6), Vec3(0.2, 30.0, 30.0));
-
-	//Walls
-	scene.Add(make_shared<Sphere>(Vec3(0, 70, 1), 64, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(0, -70, 1), 64, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(70, 0, 1), 64, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(-70, 0, 1), 64, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, 70), 64, material_ground));
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, -70), 64, material_ground));
-
-	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, blueGlow));
-	return scene;
-}
-Scene LotsOBalls()
-{
-	Scene scene;
-	scene.backgroundBottomColor = Vec3(0.01, 0.01, 0.01);
-	scene.backgroundTopColor = Vec3(0.05, 0.05, 0.05);
-	scene.cameraPos = Vec3(0, 0, 0);
+	if (argc > 1 && std::string(argv[1]) == "--bench-bvh") return BenchmarkBVH();
+	if (argc > 1 && std::string(argv[1]) == "--bench-wide-bvh") return BenchmarkWideBVH();
+	if (argc > 1 && std::string(argv[1]) == "--bench-spheres") return BenchmarkSphereStore();
+	if (argc > 1 && std::string(argv[1]) == "--bench-packets") return BenchmarkPackets();
+	if (argc > 1 && std::string(argv[1]) == "--bench-integrators") return BenchmarkIntegrators();
+	if (argc > 1 && std::string(argv[1]) == "--bench-scaling") return BenchmarkScaling();
+	if (argc > 1 && std::string(argv[1]) == "--bench-materials") return BenchmarkMaterialRefs();
+	if (argc > 1 && std::string(argv[1]) == "--bench-roulette") return BenchmarkRoulette();
+	if (argc > 1 && std::string(argv[1]) == "--bench-rng") return BenchmarkRng();
+	if (argc > 1 && std::string(argv[1]) == "--bench-convergence") return BenchmarkConvergence();
+	if (argc > 1 && std::string(argv[1]) == "--bench-adaptive") return BenchmarkAdaptive();
+	if (argc > 1 && std::string(argv[1]) == "--bench-progressive") return BenchmarkProgressive();
+	if (argc > 1 && std::string(argv[1]) == "--bench-denoise") return BenchmarkDenoise();
+	if (argc > 1 && std::string(argv[1]) == "--bench-output") return BenchmarkOutput();
+	if (argc > 1 && std::string(argv[1]) == "--bench-sequence") return BenchmarkSequence();
+	if (argc > 1 && std::string(argv[1]) == "--verify-determinism") return VerifyDeterminism();
+
+	// --trace PATH records a timeline of the session and writes it as Chrome trace JSON when the window closes
+	std::string tracePath = argc > 2 && std::string(argv[1]) == "--trace" ? argv[2] : "";
+	if (!tracePath.empty()) GlobalTracer().Start(size_t(1) << 18);
 
-	shared_ptr<Material> blueGlow = make_shared<Emmisive>(Vec3(0.6, 0.6, 0.6), Vec3(0.2, 0.2, 10.0));
-	shared_ptr<Material> metalic = make_shared<Metal>(Vec3(0.8, 0.8, 0.8));
-	shared_ptr<Material> white = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.8));
-
-	for (size_t i = 0; i < 4; i++)
-	{
-		scene.Add(make_shared<Sphere>(Vec3(RandomDouble() * 10 - 5, RandomDouble() * 10 - 5, 5 + RandomDouble() * 10), 0.5, blueGlow));
-	}
-	for (size_t i = 0; i < 4; i++)
-	{
-		scene.Add(make_shared<Sphere>(Vec3(RandomDouble() * 10 - 5, RandomDouble() * 10 - 5, 5 + RandomDouble() * 10), 0.5, metalic));
-	}
-	for (size_t i = 0; i < 8; i++)
-	{
-		scene.Add(make_shared<Sphere>(Vec3(RandomDouble() * 10 - 5, RandomDouble() * 10 - 5, 5 + RandomDouble() * 10), 0.5, white));
-	}
-	for (size_t i = 0; i < 8; i++)
-	{
-		scene.Add(make_shared<Sphere>(Vec3(RandomDouble() * 10 - 5, RandomDouble() * 10 - 5, 5 + RandomDouble() * 10), 0.5, make_shared<Lambertian>(Vec3(RandomDouble(), RandomDouble(), RandomDouble()))));
-	}
-	return scene;
-}
-int main()
-{
 	Vec3 windowSize(1920, 1080, 0);
 
 	using namespace std::chrono_literals;
@@ -149,15 +76,23 @@ int main()
 	Shader gpuShader("GPUTracer/GPUscreen.vert", "GPUTracer/GPUscreen.frag");
 	scene.CreateBuffer(gpuShader, windowSize);
 	
-	//Render
+	//Render, one sample per pixel at a time so CPU mode shows the image while it converges
 	Camera cam(windowSize.X(), windowSize.Y(), 3);
-	uint8_t* imageData = cam.Render(scene);
+	WideBVH bvh(scene.objects);
+	ProgressiveRender progressive(cam, bvh, scene.materials, cam.samplesPerPixel);
+	progressive.Start();
+	uint8_t* imageData = (uint8_t*)calloc(size_t(cam.imageWidth) * cam.imageHeight * 3, sizeof(uint8_t));
 
 	auto end = std::chrono::high_resolution_clock::now();
 	auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 	std::cout << "\nExecution Time: " << duration_ms.count() << " ms" << std::endl;
 
-	RenderQuad(windowSize, window, imageData, gpuShader, scene, true);
+	RenderQuad(windowSize, window, imageData, gpuShader, scene, true, &progressive);
+	if (!tracePath.empty())
+	{
+		GlobalTracer().Stop();
+		if (!GlobalTracer().WriteChromeJson(tracePath)) std::cout << "Could not write " << tracePath << std::endl;
+	}
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
@@ -0,0 +1,323 @@
+// Microbenchmarks for the math, sampling, intersection and shading primitives of the CPU tracer.
+// Each case runs over fixed random inputs: warm up, then timed repetitions summarized as the
+// median, spread and standard deviation of nanoseconds per call. Build with CMake; the
+// SpeedTracerMicro targets are the same suite compiled for each SIMD path.
+#include "Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+#include "Sphere.h"
+#include "Material.h"
+#include "Camera.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Simd.h"
+#include "Scenes.h"
+
+#ifndef SPEEDTRACER_VERSION
+#define SPEEDTRACER_VERSION "unknown"
+#endif
+
+// Makes the compiler treat value as used, so the work that produced it isn't optimized away
+template<typename T>
+inline void KeepAlive(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r"(&value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+struct MicroResult
+{
+	std::string name;
+	int repetitions = 0;
+	long long callsPerRepetition = 0;
+	double medianNs = 0;
+	double minNs = 0;
+	double maxNs = 0;
+	double stdDevNs = 0;
+};
+
+class MicroSuite
+{
+public:
+	std::string filter;
+	int repetitions = 15;
+	double targetRepetitionMs = 10;
+	double warmUpMs = 50;
+	std::vector<MicroResult> results;
+
+	/// <summary>
+	/// Times body(), which makes callsPerBody calls of the function under test. The body is
+	/// repeated enough times that one repetition takes about targetRepetitionMs.
+	/// </summary>
+	void Run(const std::string& name, int callsPerBody, const std::function<void()>& body)
+	{
+		if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+		// Warm up caches, branch predictors and clocks, and learn how long one body takes
+		long long bodies = 0;
+		auto start = Clock::now();
+		double elapsed = 0;
+		while (elapsed < warmUpMs || bodies < 2)
+		{
+			body();
+			bodies++;
+			elapsed = Ms(start);
+		}
+		long long bodiesPerRepetition = std::max(1LL, (long long)(targetRepetitionMs / (elapsed / bodies)));
+
+		std::vector<double> ns;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto repStart = Clock::now();
+			for (long long b = 0; b < bodiesPerRepetition; b++) body();
+			ns.push_back(Ms(repStart) * 1e6 / (double(bodiesPerRepetition) * callsPerBody));
+		}
+
+		MicroResult result;
+		result.name = name;
+		result.repetitions = repetitions;
+		result.callsPerRepetition = bodiesPerRepetition * callsPerBody;
+		std::sort(ns.begin(), ns.end());
+		result.medianNs = ns.size() % 2 ? ns[ns.size() / 2] : 0.5 * (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]);
+		result.minNs = ns.front();
+		result.maxNs = ns.back();
+		double mean = 0;
+		for (double v : ns) mean += v / ns.size();
+		for (double v : ns) result.stdDevNs += (v - mean) * (v - mean) / std::max<size_t>(1, ns.size() - 1);
+		result.stdDevNs = std::sqrt(result.stdDevNs);
+		results.push_back(result);
+		printf("%-36s %10.2f %10.2f %10.2f %8.2f\n", name.c_str(), result.medianNs, result.minNs, result.maxNs, result.stdDevNs);
+		fflush(stdout);
+	}
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+	static double Ms(Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); }
+};
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: SpeedTracerMicro [options]\n"
+		"  --filter TEXT   only cases whose name contains TEXT\n"
+		"  --repeat N      timed repetitions per case (default 15)\n"
+		"  --json PATH     also write the results as JSON\n");
+}
+
+int main(int argc, char* argv[])
+{
+	MicroSuite suite;
+	std::string jsonPath;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--help" || arg == "-h")
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (arg == "--filter" && hasValue) suite.filter = argv[++i];
+		else if (arg == "--repeat" && hasValue) suite.repetitions = std::max(1, atoi(argv[++i]));
+		else if (arg == "--json" && hasValue) jsonPath = argv[++i];
+		else
+		{
+			fprintf(stderr, "Unknown option or missing value: %s\n", arg.c_str());
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	// Fixed inputs: the same values every run and on every SIMD path
+	const int n = 4096;
+	Pcg32 generator(20240601u);
+	auto uniform = [&](double min, double max) { return min + generator.NextDouble() * (max - min); };
+	auto randomVec = [&](double min, double max) { return Vec3(uniform(min, max), uniform(min, max), uniform(min, max)); };
+
+	std::vector<Vec3> a(n), b(n), out(n);
+	std::vector<double> scalars(n), dots(n);
+	for (int i = 0; i < n; i++)
+	{
+		a[i] = randomVec(-1, 1);
+		b[i] = randomVec(-1, 1);
+		scalars[i] = uniform(0.5, 2);
+	}
+
+	// Rays from around the origin towards the SampleScene spheres, about half of them hit
+	std::vector<Ray> rays(n);
+	for (int i = 0; i < n; i++) rays[i] = Ray(randomVec(-0.1, 0.1), Vec3(uniform(-1.5, 1.5), uniform(-0.8, 0.8), 1));
+	std::vector<HitInfo> hits(n);
+	std::vector<Sampler> samplers(n);
+
+	printf("SpeedTracer microbenchmarks, %s, SIMD %s, %d inputs\n", SPEEDTRACER_VERSION, SimdName(), n);
+	printf("%-36s %10s %10s %10s %8s\n", "ns per call", "median", "min", "max", "stddev");
+
+	// Vec3.h
+	suite.Run("Vec3 a + b * s", n, [&]() { for (int i = 0; i < n; i++) out[i] = a[i] + b[i] * scalars[i]; KeepAlive(out); });
+	suite.Run("Vec3 a * b - a / s", n, [&]() { for (int i = 0; i < n; i++) out[i] = a[i] * b[i] - a[i] / scalars[i]; KeepAlive(out); });
+	suite.Run("Vec3 Dot", n, [&]() { for (int i = 0; i < n; i++) dots[i] = Dot(a[i], b[i]); KeepAlive(dots); });
+	suite.Run("Vec3 Cross", n, [&]() { for (int i = 0; i < n; i++) out[i] = Cross(a[i], b[i]); KeepAlive(out); });
+	suite.Run("Vec3 Length", n, [&]() { for (int i = 0; i < n; i++) dots[i] = a[i].Length(); KeepAlive(dots); });
+	suite.Run("Vec3 Normalize", n, [&]() { for (int i = 0; i < n; i++) out[i] = Normalize(a[i]); KeepAlive(out); });
+	suite.Run("Vec3 Reflect", n, [&]() { for (int i = 0; i < n; i++) out[i] = Reflect(a[i], b[i]); KeepAlive(out); });
+	suite.Run("Vec3 RotateEuler", n, [&]() { for (int i = 0; i < n; i++) out[i] = RotateEuler(a[i], b[i] * 180.0); KeepAlive(out); });
+	suite.Run("Vec3 RandomUnitVector (rejection)", n, [&]() { for (int i = 0; i < n; i++) out[i] = RandomUnitVector(); KeepAlive(out); });
+	for (SamplerType type : { SamplerType::Independent, SamplerType::Sobol, SamplerType::BlueNoise })
+	{
+		const char* names[] = { "independent", "sobol", "blue noise" };
+		Sampler sampler(7, type);
+		suite.Run(std::string("Vec3 RandomUnitVector (") + names[int(type)] + ")", n, [&]()
+		{
+			for (int i = 0; i < n; i++)
+			{
+				sampler.StartSample(i & 63, i >> 6, 0);
+				out[i] = RandomUnitVector(sampler);
+			}
+			KeepAlive(out);
+		});
+	}
+
+	// Random.h, the SIMD variant steps simdWidth streams per call
+	{
+		Pcg32 pcg(1);
+		std::vector<uint32_t> values(n);
+		suite.Run("Pcg32 NextUInt", n, [&]() { for (int i = 0; i < n; i++) values[i] = pcg.NextUInt(); KeepAlive(values); });
+		Pcg32Wide wide(1);
+		suite.Run("Pcg32Wide NextUInts (per value)", n, [&]() { for (int i = 0; i < n; i += simdWidth) wide.NextUInts(&values[i]); KeepAlive(values); });
+	}
+
+	// Sphere.h and the scene level intersection, scalar loop against the SIMD structures
+	{
+		Sphere sphere(Vec3(0, 0, 1.2), 0.5, 0);
+		suite.Run("Sphere::CheckHit", n, [&]()
+		{
+			for (int i = 0; i < n; i++) sphere.CheckHit(rays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+
+		Scene sample = SampleScene();
+		suite.Run("Scene::CheckHit SampleScene", n, [&]()
+		{
+			for (int i = 0; i < n; i++) sample.CheckHit(rays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+		Scene packed = SampleScene();
+		packed.PackSpheres();
+		suite.Run("SphereSoA::CheckHit SampleScene", n, [&]()
+		{
+			for (int i = 0; i < n; i++) packed.CheckHit(rays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+
+		Scene balls = LotsOBalls(1000, 1);
+		std::vector<Ray> ballRays(n);
+		for (int i = 0; i < n; i++) ballRays[i] = Ray(Vec3(0, 0, 0), Vec3(uniform(-0.5, 0.5), uniform(-0.5, 0.5), 1));
+		suite.Run("Scene::CheckHit 1k balls", n / 16, [&]()
+		{
+			for (int i = 0; i < n / 16; i++) balls.CheckHit(ballRays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+		BVH bvh(balls.objects);
+		suite.Run("BVH::CheckHit 1k balls", n, [&]()
+		{
+			for (int i = 0; i < n; i++) bvh.CheckHit(ballRays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+		WideBVH wide(balls.objects);
+		suite.Run("WideBVH::CheckHit 1k balls", n, [&]()
+		{
+			for (int i = 0; i < n; i++) wide.CheckHit(ballRays[i], Interval(0.003, infinity), hits[i]);
+			KeepAlive(hits);
+		});
+	}
+
+	// Material.h: the virtual Scatter of each material, the record switch and the binned ScatterN
+	{
+		MaterialTable materials;
+		uint32_t ids[] = {
+			materials.Add(make_shared<Lambertian>(Vec3(0.8, 0.8, 0.8))),
+			materials.Add(make_shared<Metal>(Vec3(0.8, 0.6, 0.2))),
+			materials.Add(make_shared<Emmisive>(Vec3(0.6, 0.6, 0.6), Vec3(0.2, 0.2, 10.0)))
+		};
+		const char* names[] = { "Lambertian", "Metal", "Emmisive" };
+
+		// Hits on a unit sphere, one per ray
+		std::vector<HitInfo> surface(n);
+		for (int i = 0; i < n; i++)
+		{
+			Vec3 normal = Normalize(a[i]);
+			surface[i].p = normal;
+			surface[i].t = 1;
+			surface[i].SetFaceNormal(rays[i], normal);
+		}
+		for (int i = 0; i < n; i++) samplers[i] = Sampler(uint32_t(i), SamplerType::Independent);
+
+		std::vector<Vec3> attenuation(n);
+		std::vector<Ray> scattered(n);
+		std::vector<uint8_t> scatters(n);
+		for (int m = 0; m < 3; m++)
+		{
+			for (HitInfo& hit : surface) hit.materialId = ids[m];
+			const Material& material = materials[ids[m]];
+			suite.Run(std::string("Material::Scatter ") + names[m], n, [&]()
+			{
+				for (int i = 0; i < n; i++) scatters[i] = material.Scatter(rays[i], surface[i], attenuation[i], scattered[i], samplers[i]);
+				KeepAlive(scattered);
+			});
+			const MaterialRecord& record = materials.Record(ids[m]);
+			suite.Run(std::string("Scatter(MaterialRecord) ") + names[m], n, [&]()
+			{
+				for (int i = 0; i < n; i++) scatters[i] = Scatter(record, rays[i], surface[i], attenuation[i], scattered[i], samplers[i]);
+				KeepAlive(scattered);
+			});
+			suite.Run(std::string("ScatterN ") + names[m], n, [&]()
+			{
+				ScatterN(record.type, n, materials.Records(), rays.data(), surface.data(), attenuation.data(), scattered.data(), scatters.data(), samplers.data());
+				KeepAlive(scattered);
+			});
+		}
+	}
+
+	// Color.h
+	{
+		const int width = 64;
+		std::vector<uint8_t> image(size_t(n) * 3);
+		std::vector<Vec3> colors(n);
+		for (int i = 0; i < n; i++) colors[i] = randomVec(0, 1);
+		suite.Run("WriteColor", n, [&]()
+		{
+			for (int i = 0; i < n; i++) WriteColor(image.data(), colors[i], i % width, i / width, width);
+			KeepAlive(image);
+		});
+		suite.Run("LinearToGamma", n, [&]() { for (int i = 0; i < n; i++) dots[i] = LinearToGamma(colors[i].X()); KeepAlive(dots); });
+	}
+
+	if (jsonPath.empty()) return 0;
+	FILE* file = fopen(jsonPath.c_str(), "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Could not write %s\n", jsonPath.c_str());
+		return 1;
+	}
+	fprintf(file, "{\n  \"benchmark\": \"SpeedTracerMicro\",\n  \"version\": \"%s\",\n  \"simd\": \"%s\",\n  \"inputs\": %d,\n  \"cases\": [\n", SPEEDTRACER_VERSION, SimdName(), n);
+	for (size_t k = 0; k < suite.results.size(); k++)
+	{
+		const MicroResult& r = suite.results[k];
+		fprintf(file, "    { \"name\": \"%s\", \"repetitions\": %d, \"callsPerRepetition\": %lld, \"medianNs\": %.4f, \"minNs\": %.4f, \"maxNs\": %.4f, \"stdDevNs\": %.4f }%s\n",
+			r.name.c_str(), r.repetitions, r.callsPerRepetition, r.medianNs, r.minNs, r.maxNs, r.stdDevNs, k + 1 < suite.results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	return fclose(file) == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "Utils.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Material.h"
+
+Scene TestScene()
+{
+	Scene scene;
+
+	//Materials
+	uint32_t ground = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.94, 0.94, 0.96)));
+	uint32_t red = scene.AddMaterial(make_shared<Emmisive>(Vec3(0.2, 0.2, 0.2), Vec3(0.7, 0.2, 0.2)));
+	uint32_t metalic = scene.AddMaterial(make_shared<Metal>(Vec3(0.8, 0.8, 0.8)));
+	uint32_t black = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.1, 0.1, 0.1)));
+
+	//Scene
+	scene.backgroundTopColor = Vec3(0.0, 0.05, 0.1);
+	scene.backgroundBottomColor = Vec3(0.0, 0.0, 0.0);
+	scene.cameraPos = Vec3(0, 0, 0);
+
+	scene.Add(make_shared<Sphere>(Vec3(0, -100.5, 1), 100.0, ground));
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.5), 0.6, red));
+	scene.Add(make_shared<Sphere>(Vec3(-1.3, 0, 1.5), 0.8, metalic));
+	scene.Add(make_shared<Sphere>(Vec3(2, 0.7, 2), 0.5, black));
+	return scene;
+}
+Scene SampleScene()
+{
+	Scene scene;
+
+	//Materials
+	uint32_t material_ground = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.8, 0.8, 0.8)));
+	uint32_t material_center = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.1, 0.2, 0.5)));
+	uint32_t material_left = scene.AddMaterial(make_shared<Metal>(Vec3(0.8, 0.8, 0.8)));
+	uint32_t material_right = scene.AddMaterial(make_shared<Metal>(Vec3(0.8, 0.6, 0.2)));
+
+	//Scene
+	scene.backgroundTopColor = Vec3(1.0, 1.0, 1.0);
+	scene.backgroundBottomColor = Vec3(0.5, 0.7, 1.0);
+	scene.cameraPos = Vec3(0, 0, 0);
+
+	scene.Add(make_shared<Sphere>(Vec3(0, -100.5, 1), 100.0, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, material_center));
+	scene.Add(make_shared<Sphere>(Vec3(-1.0, 0, 1.0), 0.5, material_left));
+	scene.Add(make_shared<Sphere>(Vec3(1, 0.0, 1.0), 0.5, material_right));
+	return scene;
+}
+Scene BasicScene()
+{
+	Scene scene;
+	scene.backgroundTopColor = Vec3(1.0, 1.0, 1.0);
+	scene.backgroundBottomColor = Vec3(0.5, 0.7, 1.0);
+	scene.cameraPos = Vec3(0, 0, 0);
+	uint32_t material_ground = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0)));
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, material_ground));
+	return scene;
+}
+Scene Room()
+{
+	Scene scene;
+	scene.backgroundTopColor = Vec3(1,1,1);
+	scene.backgroundBottomColor = Vec3(0.5,0.5,0.5);
+	
+	//Materials
+	uint32_t material_ground = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0)));
+	uint32_t blueGlow = scene.AddMaterial(make_shared<Emmisive>(Vec3(0.6, 0.6, 0.6), Vec3(0.2, 30.0, 30.0)));
+
+	//Walls
+	scene.Add(make_shared<Sphere>(Vec3(0, 70, 1), 64, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(0, -70, 1), 64, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(70, 0, 1), 64, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(-70, 0, 1), 64, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, 70), 64, material_ground));
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, -70), 64, material_ground));
+
+	scene.Add(make_shared<Sphere>(Vec3(0, 0, 1.2), 0.5, blueGlow));
+	return scene;
+}
+/// <summary>
+/// Random cloud of balls. count scales the scene up for benchmarking, the box the balls
+/// are spread over grows with it so the density stays the same. A seed other than 0 gives the
+/// same cloud every time, 0 a new one each run.
+/// </summary>
+Scene LotsOBalls(int count = 24, uint32_t seed = 0)
+{
+	Pcg32 generator(seed ? seed : std::random_device{}());
+	auto random = [&]() { return generator.NextDouble(); };
+
+	Scene scene;
+	scene.backgroundBottomColor = Vec3(0.01, 0.01, 0.01);
+	scene.backgroundTopColor = Vec3(0.05, 0.05, 0.05);
+	scene.cameraPos = Vec3(0, 0, 0);
+
+	uint32_t blueGlow = scene.AddMaterial(make_shared<Emmisive>(Vec3(0.6, 0.6, 0.6), Vec3(0.2, 0.2, 10.0)));
+	uint32_t metalic = scene.AddMaterial(make_shared<Metal>(Vec3(0.8, 0.8, 0.8)));
+	uint32_t white = scene.AddMaterial(make_shared<Lambertian>(Vec3(0.8, 0.8, 0.8)));
+
+	double size = 10 * std::cbrt(count / 24.0);
+	auto randomCenter = [size, &random]() { return Vec3(random() * size - size / 2, random() * size - size / 2, 5 + random() * size); };
+
+	for (int i = 0; i < count / 6; i++)
+	{
+		scene.Add(make_shared<Sphere>(randomCenter(), 0.5, blueGlow));
+	}
+	for (int i = 0; i < count / 6; i++)
+	{
+		scene.Add(make_shared<Sphere>(randomCenter(), 0.5, metalic));
+	}
+	for (int i = 0; i < count / 3; i++)
+	{
+		scene.Add(make_shared<Sphere>(randomCenter(), 0.5, white));
+	}
+	for (int i = int(scene.objects.size()); i < count; i++)
+	{
+		scene.Add(make_shared<Sphere>(randomCenter(), 0.5, scene.AddMaterial(make_shared<Lambertian>(Vec3(random(), random(), random())))));
+	}
+	return scene;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "Utils.h"
+#include "Scenes.h"
+#include "Camera.h"
+#include "WideBVH.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Renders SampleScene() with 1, 4 and every hardware thread for each integrator and for adaptive
+/// sampling, and checks the images are byte for byte identical and that a different seed does
+/// change the image.
+/// Returns 0 when everything matches, 1 otherwise.
+/// </summary>
+int VerifyDeterminism()
+{
+	struct Mode
+	{
+		const char* name;
+		Integrator integrator;
+		int packetSize;
+		bool adaptive;
+	};
+	const Mode modes[] = {
+		{ "path", Integrator::Path, 0, false },
+		{ "packets", Integrator::Path, 8, false },
+		{ "wavefront", Integrator::Wavefront, 0, false },
+		{ "adaptive", Integrator::Path, 0, true }
+	};
+	const int threadCounts[] = { 1, 4, std::max(1, int(std::thread::hardware_concurrency())) };
+
+	Scene scene = SampleScene();
+	WideBVH bvh(scene.objects);
+	Camera cam(320, 180, 4);
+	cam.outputPath = "";
+	cam.maxSamplesPerPixel = 16;
+	const size_t bytes = size_t(cam.imageWidth) * cam.imageHeight * 3;
+
+	bool passed = true;
+	for (const Mode& mode : modes)
+	{
+		cam.integrator = mode.integrator;
+		cam.packetSize = mode.packetSize;
+		cam.adaptiveSampling = mode.adaptive;
+		cam.seed = 1;
+
+		cam.threadCount = threadCounts[0];
+		std::vector<uint8_t> reference(bytes);
+		uint8_t* image = cam.Render(bvh, scene.materials);
+		memcpy(reference.data(), image, bytes);
+		free(image);
+
+		for (int threads : threadCounts)
+		{
+			cam.threadCount = threads;
+			image = cam.Render(bvh, scene.materials);
+			size_t differing = 0;
+			for (size_t i = 0; i < bytes; i++) differing += image[i] != reference[i];
+			free(image);
+
+			printf("%-10s %3d threads: %s", mode.name, threads, differing == 0 ? "identical\n" : "DIFFERENT");
+			if (differing) printf(" (%zu of %zu bytes)\n", differing, bytes);
+			passed &= differing == 0;
+		}
+
+		cam.seed = 2;
+		image = cam.Render(bvh, scene.materials);
+		bool changed = memcmp(image, reference.data(), bytes) != 0;
+		free(image);
+		printf("%-10s other seed:  %s\n", mode.name, changed ? "changes the image" : "SAME IMAGE");
+		passed &= changed;
+	}
+
+	printf(passed ? "Determinism check passed\n" : "Determinism check FAILED\n");
+	return passed ? 0 : 1;
+}
+
+#endif